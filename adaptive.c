@@ -0,0 +1,127 @@
+#include "adaptive.h"
+#include "est_time.h"
+#include <string.h>
+
+// Builds the communicators for (ans[0] over ans[2], ans[1] over P/ans[2])
+static void use_plan(adaptive_ctx *ad, const ll *ans, double predicted) {
+    ad->algos[0] = ans[0];
+    ad->algos[1] = ans[1];
+    ad->Pc = ans[2];
+    ad->predicted = predicted;
+    ll dims[2] = {ad->Pc, ad->P / ad->Pc};
+    grid_comms_create(ad->comm, 2, dims, &ad->grid);
+}
+
+static void rls_init(rls_state *r, double alpha, double beta) {
+    r->theta[0] = alpha;
+    r->theta[1] = beta;
+    r->primed = 0;
+}
+
+// One RLS step for y = theta . x with forgetting factor ADAPT_FORGET
+static void rls_update(rls_state *r, const double *x, double y) {
+    // alpha and beta live on scales 1e4 apart, so the prior covariance is taken from the first
+    // sample's features: the prior then weighs as much as one observation
+    if (!r->primed) {
+        for (int i = 0; i < 2; i++)
+            for (int j = 0; j < 2; j++)
+                r->cov[i][j] = (i == j) ? 1.0 / (x[i] * x[i] + 1e-300) : 0;
+        r->primed = 1;
+    }
+    double Px[2] = {r->cov[0][0] * x[0] + r->cov[0][1] * x[1],
+                    r->cov[1][0] * x[0] + r->cov[1][1] * x[1]};
+    double denom = ADAPT_FORGET + x[0] * Px[0] + x[1] * Px[1];
+    double k[2] = {Px[0] / denom, Px[1] / denom};
+    double err = y - (r->theta[0] * x[0] + r->theta[1] * x[1]);
+
+    for (int i = 0; i < 2; i++) {
+        r->theta[i] += k[i] * err;
+        if (r->theta[i] < 0) r->theta[i] = 0;		// latency and inverse bandwidth cannot be negative
+    }
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 2; j++)
+            r->cov[i][j] = (r->cov[i][j] - k[i] * Px[j]) / ADAPT_FORGET;
+}
+
+void adaptive_init(adaptive_ctx *ad, MPI_Comm comm, ll m, ll ms) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    memset(ad, 0, sizeof(*ad));
+    ad->comm = comm;
+    ad->P = size;
+    ad->ms = ms;
+
+    get_params(ad->abg);
+    for (int a = 0; a < NUM_ALGOS; a++) rls_init(&ad->rls[a], ad->abg[0][a], ad->abg[1][a]);
+
+    ll ans[3];
+    double predicted = Stage1(ad->P, m, ms, ans);
+    use_plan(ad, ans, predicted);
+}
+
+// Folds the interval's slowest-rank times into the fits, then re-runs Stage1
+static void refit(adaptive_ctx *ad) {
+    double slowest[ADAPT_INTERVAL][2];
+    MPI_Allreduce(ad->pending_times, slowest, 2 * ad->pending, MPI_DOUBLE, MPI_MAX, ad->comm);
+
+    ll dims[2] = {ad->Pc, ad->P / ad->Pc};
+    for (int i = 0; i < ad->pending; i++) {
+        ll m = ad->pending_m[i];
+        for (int d = 0; d < 2; d++) {
+            int a = ad->algos[d];
+            if (dims[d] <= 1) continue;			// a one-rank dimension says nothing about the network
+
+            algo_entry *e = &algo_registry[a];
+            double x[2] = {e->cost(dims[d], m, ad->ms, 1, 0, 0), e->cost(dims[d], m, ad->ms, 0, 1, 0)};
+            double y = slowest[i][d] - e->cost(dims[d], m, ad->ms, 0, 0, ad->abg[2][a]);
+            rls_update(&ad->rls[a], x, y);
+        }
+    }
+    ll m = ad->pending_m[ad->pending - 1];
+    ad->pending = 0;
+
+    for (int a = 0; a < NUM_ALGOS; a++) {
+        ad->abg[0][a] = ad->rls[a].theta[0];
+        ad->abg[1][a] = ad->rls[a].theta[1];
+    }
+    set_params(ad->abg);
+
+    // The current plan, re-costed with the new parameters, is the bar to beat
+    double current = 0;
+    for (int d = 0; d < 2; d++) {
+        int a = ad->algos[d];
+        current += algo_registry[a].cost(dims[d], m, ad->ms, ad->abg[0][a], ad->abg[1][a], ad->abg[2][a]);
+    }
+    ll ans[3];
+    double best = Stage1(ad->P, m, ad->ms, ans);
+
+    if (best < (1 - ADAPT_SWITCH_MARGIN) * current &&
+        (ans[0] != ad->algos[0] || ans[1] != ad->algos[1] || ans[2] != ad->Pc)) {
+        if (ans[2] != ad->Pc) {
+            grid_comms_free(&ad->grid);
+            use_plan(ad, ans, best);
+        } else {
+            ad->algos[0] = ans[0];
+            ad->algos[1] = ans[1];
+            ad->predicted = best;
+        }
+        ad->switches++;
+    } else {
+        ad->predicted = current;
+    }
+}
+
+void adaptive_allreduce(adaptive_ctx *ad, void *sendbuf, void *recvbuf, ll count,
+                        MPI_Datatype datatype, MPI_Op op) {
+    int type_size;
+    MPI_Type_size(datatype, &type_size);
+
+    grid_allreduce_timed(sendbuf, recvbuf, count, datatype, op, &ad->grid, ad->algos,
+                         ad->pending_times[ad->pending]);
+    ad->pending_m[ad->pending] = (count * type_size + 7) / 8;
+    if (++ad->pending == ADAPT_INTERVAL) refit(ad);
+}
+
+void adaptive_free(adaptive_ctx *ad) {
+    grid_comms_free(&ad->grid);
+}
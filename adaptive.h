@@ -0,0 +1,64 @@
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include "macros.h"
+#include "grid_allreduce.h"
+
+/**
+ * @brief Online adaptive SUARA: the 2D plan follows the measured times.
+ *
+ * adaptive_allreduce() runs the current (algorow over Pc, algocol over P/Pc)
+ * plan and records how long each dimension took on this rank. Every
+ * ADAPT_INTERVAL calls the records are max-reduced over comm (one
+ * collective per interval) and folded into a recursive least squares fit
+ * of each algorithm's alpha and beta, with forgetting factor ADAPT_FORGET so
+ * old samples fade as the network drifts. gamma stays at its calibrated
+ * value. Stage1 is then re-run on the refitted parameters, and the plan
+ * switches if the new winner is predicted at least ADAPT_SWITCH_MARGIN
+ * faster than the current plan.
+ *
+ * Every rank folds the same max-reduced samples in the same order, so all
+ * ranks reach the same decision without a broadcast.
+ *
+ * Usage (after my_init or calibrate + set_params on every rank):
+ *     adaptive_ctx ad;
+ *     adaptive_init(&ad, MPI_COMM_WORLD, m, SEG_SIZE);
+ *     for (...) adaptive_allreduce(&ad, sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM);
+ *     adaptive_free(&ad);
+ */
+
+#define ADAPT_INTERVAL 16
+#define ADAPT_FORGET 0.95
+#define ADAPT_SWITCH_MARGIN 0.05
+
+typedef struct {
+    double theta[2];            // alpha, beta
+    double cov[2][2];           // RLS inverse information matrix
+    int primed;                 // cov set from the first sample
+} rls_state;
+
+typedef struct {
+    MPI_Comm comm;
+    ll P, ms;
+
+    ll algos[2];                // algorow, algocol
+    ll Pc;
+    grid_comms grid;            // dims {Pc, P/Pc}
+    double predicted;           // model time of the current plan
+
+    double abg[3][NUM_ALGOS];   // current parameters (also installed with set_params)
+    rls_state rls[NUM_ALGOS];
+
+    int pending;                // calls since the last refit
+    double pending_times[ADAPT_INTERVAL][2];
+    ll pending_m[ADAPT_INTERVAL];   // in 8-byte elements, like Stage1's m
+
+    int switches;
+} adaptive_ctx;
+
+void adaptive_init(adaptive_ctx *ad, MPI_Comm comm, ll m, ll ms);
+void adaptive_allreduce(adaptive_ctx *ad, void *sendbuf, void *recvbuf, ll count,
+                        MPI_Datatype datatype, MPI_Op op);
+void adaptive_free(adaptive_ctx *ad);
+
+#endif
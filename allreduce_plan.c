@@ -0,0 +1,337 @@
+#include "allreduce_plan.h"
+#include "ring_seg_allreduce.h"
+#include "tree_allreduce.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+static void add_step(allreduce_plan *plan, int send_peer, ll send_off, ll send_len,
+                     int recv_peer, ll recv_off, ll recv_len, int reduce) {
+    plan_step *st = &plan->steps[plan->nsteps++];
+    st->send_peer = send_peer;
+    st->send_off = send_off;
+    st->send_len = send_len;
+    st->recv_peer = recv_peer;
+    st->recv_off = recv_off;
+    st->recv_len = recv_len;
+    st->reduce = reduce;
+    if (reduce && recv_len > plan->scratch_len) plan->scratch_len = recv_len;
+}
+
+// Same schedule as ring_allreduce: size-1 reduce-scatter steps, size-1 allgather steps
+static void build_ring(allreduce_plan *plan) {
+    int rank = plan->rank, size = plan->size;
+    ll *chunk_off = (ll *) malloc(sizeof(ll) * (size + 1));
+    chunk_offsets(plan->count, size, chunk_off);
+    int send_to = (rank + 1) % size;
+    int recv_from = (rank - 1 + size) % size;
+
+    for (int step = 0; step < 2 * (size - 1); step++) {
+        int send_chunk_idx = (rank - step + 2 * size) % size;
+        int recv_chunk_idx = (rank - step - 1 + 2 * size) % size;
+        add_step(plan, send_to, chunk_off[send_chunk_idx],
+                 chunk_off[send_chunk_idx + 1] - chunk_off[send_chunk_idx],
+                 recv_from, chunk_off[recv_chunk_idx],
+                 chunk_off[recv_chunk_idx + 1] - chunk_off[recv_chunk_idx],
+                 step < size - 1);
+    }
+    free(chunk_off);
+}
+
+// Fold the first 2*rem ranks into a power-of-2 core (as in rabenseifner_allreduce).
+// Returns the rank inside the core, or -1 for ranks that sit out.
+static int build_fold(allreduce_plan *plan, int *pof2_out, int *rem_out) {
+    int rank = plan->rank, size = plan->size;
+    int pof2 = 1;
+    while (pof2 * 2 <= size) pof2 *= 2;
+    int rem = size - pof2;
+    *pof2_out = pof2;
+    *rem_out = rem;
+
+    if (rank < 2 * rem) {
+        if (rank % 2 == 0) {
+            add_step(plan, rank + 1, 0, plan->count, -1, 0, 0, 0);
+            return -1;
+        }
+        add_step(plan, -1, 0, 0, rank - 1, 0, plan->count, 1);
+        return rank / 2;
+    }
+    return rank - rem;
+}
+
+static void build_unfold(allreduce_plan *plan, int rem) {
+    int rank = plan->rank;
+    if (rank >= 2 * rem) return;
+    if (rank % 2 == 0) add_step(plan, -1, 0, 0, rank + 1, 0, plan->count, 0);
+    else               add_step(plan, rank - 1, 0, plan->count, -1, 0, 0, 0);
+}
+
+static int core_to_rank(int newrank, int rem) {
+    return (newrank < rem) ? newrank * 2 + 1 : newrank + rem;
+}
+
+static void build_recursive_doubling(allreduce_plan *plan) {
+    int pof2, rem;
+    int newrank = build_fold(plan, &pof2, &rem);
+    if (newrank != -1) {
+        for (int mask = 1; mask < pof2; mask <<= 1) {
+            int partner = core_to_rank(newrank ^ mask, rem);
+            add_step(plan, partner, 0, plan->count, partner, 0, plan->count, 1);
+        }
+    }
+    build_unfold(plan, rem);
+}
+
+static void build_rabenseifner(allreduce_plan *plan) {
+    int pof2, rem;
+    int newrank = build_fold(plan, &pof2, &rem);
+    if (newrank != -1) {
+        ll recv_size = plan->count, recv_offset = 0;
+        ll win_offset[32], win_size[32];
+        int level = 0;
+
+        // Reduce-scatter: keep one half of the window, ship the other
+        for (int mask = 1; mask < pof2; mask *= 2) {
+            int newpartner = newrank ^ mask;
+            int partner = core_to_rank(newpartner, rem);
+            ll lower = recv_size / 2, upper = recv_size - lower;
+            win_offset[level] = recv_offset;
+            win_size[level] = recv_size;
+            level++;
+
+            if (newrank < newpartner) {
+                add_step(plan, partner, recv_offset + lower, upper, partner, recv_offset, lower, 1);
+                recv_size = lower;
+            } else {
+                add_step(plan, partner, recv_offset, lower, partner, recv_offset + lower, upper, 1);
+                recv_offset += lower;
+                recv_size = upper;
+            }
+        }
+
+        // Allgather: retrace the windows in reverse
+        for (int mask = pof2 / 2; mask > 0; mask /= 2) {
+            int newpartner = newrank ^ mask;
+            int partner = core_to_rank(newpartner, rem);
+            level--;
+            ll lower = win_size[level] / 2, upper = win_size[level] - lower;
+            if (newrank < newpartner)
+                add_step(plan, partner, recv_offset, recv_size, partner, win_offset[level] + lower, upper, 0);
+            else
+                add_step(plan, partner, recv_offset, recv_size, partner, win_offset[level], lower, 0);
+            recv_offset = win_offset[level];
+            recv_size = win_size[level];
+        }
+    }
+    build_unfold(plan, rem);
+}
+
+static ll tree_seg_size(ll count) {
+    return (SEG_SIZE > 0 && SEG_SIZE < count) ? SEG_SIZE : count;
+}
+
+static int tree_nseg(ll count) {
+    ll seg = tree_seg_size(count);
+    return seg > 0 ? (int)((count + seg - 1) / seg) : 0;
+}
+
+// Same tree and segments as tree_allreduce, over [base, base + count), one segment per
+// step: the first step of each round sends the previous segment on while the next one comes in
+static void build_tree_slice(allreduce_plan *plan, int parent, const int child[2], ll base, ll count) {
+    if (plan->size == 1 || count == 0) return;
+    ll seg = tree_seg_size(count);
+    int nseg = tree_nseg(count);
+
+    for (int k = 0; k <= nseg; k++) {
+        ll off = base + k * seg, len = (k < nseg) ? ((k == nseg - 1) ? base + count - off : seg) : 0;
+        ll prev_off = off - seg, prev_len = (k > 0) ? ((k == nseg) ? base + count - prev_off : seg) : 0;
+        int up = (k > 0 && parent >= 0) ? parent : -1;
+        int c0 = (k < nseg) ? child[0] : -1;
+        int c1 = (k < nseg) ? child[1] : -1;
+        if (up >= 0 || c0 >= 0) add_step(plan, up, prev_off, prev_len, c0, off, c0 >= 0 ? len : 0, c0 >= 0);
+        if (c1 >= 0)            add_step(plan, -1, 0, 0, c1, off, len, 1);
+    }
+    for (int k = 0; k <= nseg; k++) {
+        ll off = base + k * seg, len = (k < nseg) ? ((k == nseg - 1) ? base + count - off : seg) : 0;
+        ll prev_off = off - seg, prev_len = (k > 0) ? ((k == nseg) ? base + count - prev_off : seg) : 0;
+        int down = (k < nseg) ? parent : -1;
+        int c0 = (k > 0) ? child[0] : -1;
+        int c1 = (k > 0) ? child[1] : -1;
+        if (down >= 0 || c0 >= 0) add_step(plan, c0, prev_off, prev_len, down, off, down >= 0 ? len : 0, 0);
+        if (c1 >= 0)              add_step(plan, c1, prev_off, prev_len, -1, 0, 0, 0);
+    }
+}
+
+// Same chain and segments as linear_allreduce: a tree in which rank i's only child is i+1
+static void build_linear(allreduce_plan *plan) {
+    int rank = plan->rank;
+    int child[2] = {rank < plan->size - 1 ? rank + 1 : -1, -1};
+    build_tree_slice(plan, rank - 1, child, 0, plan->count);
+}
+
+static void build_tree(allreduce_plan *plan) {
+    int parent, child[2];
+    btree_links(plan->rank, plan->size, &parent, child);
+    build_tree_slice(plan, parent, child, 0, plan->count);
+}
+
+// The two halves of double_tree_allreduce one after the other: a step list runs one
+// step at a time, so the kernel's interleaving of the two trees is not reproduced
+static void build_double_tree(allreduce_plan *plan) {
+    ll half = dbtree_split(plan->count);
+    for (int i = 0; i < 2; i++) {
+        int parent, child[2];
+        dbtree_links(i, plan->rank, plan->size, &parent, child);
+        build_tree_slice(plan, parent, child, i ? half : 0, i ? plan->count - half : half);
+    }
+}
+
+static void release_requests(allreduce_plan *plan) {
+    if (plan->bound_buf == NULL) return;
+    for (int i = 0; i < plan->nsteps; i++) {
+        for (int r = 0; r < plan->nreqs[i]; r++) {
+            MPI_Request_free(&plan->reqs[2 * i + r]);
+        }
+    }
+    plan->bound_buf = NULL;
+}
+
+// Persistent requests capture buffer addresses, so they are (re)built whenever
+// execute() is handed a recvbuf other than the one they were bound to
+static void bind_requests(allreduce_plan *plan, char *recv_buf) {
+    release_requests(plan);
+    for (int i = 0; i < plan->nsteps; i++) {
+        plan_step *st = &plan->steps[i];
+        MPI_Request *req = &plan->reqs[2 * i];
+        int n = 0;
+        if (st->recv_peer >= 0) {
+            char *dst = st->reduce ? plan->scratch : recv_buf + st->recv_off * plan->type_size;
+            MPI_Recv_init(dst, st->recv_len, plan->datatype, st->recv_peer, plan->tag, plan->comm, &req[n++]);
+        }
+        if (st->send_peer >= 0) {
+            MPI_Send_init(recv_buf + st->send_off * plan->type_size, st->send_len, plan->datatype, st->send_peer, plan->tag, plan->comm, &req[n++]);
+        }
+        plan->nreqs[i] = n;
+    }
+    plan->bound_buf = recv_buf;
+}
+
+allreduce_plan *allreduce_plan_create(MPI_Comm comm, ll count, MPI_Datatype datatype, MPI_Op op, int algo) {
+    allreduce_plan *plan = (allreduce_plan *) calloc(1, sizeof(allreduce_plan));
+    plan->comm = comm;
+    plan->count = count;
+    plan->datatype = datatype;
+    plan->op = op;
+    plan->algo = algo;
+    MPI_Comm_rank(comm, &plan->rank);
+    MPI_Comm_size(comm, &plan->size);
+    MPI_Type_size(datatype, &plan->type_size);
+    plan->reduce = get_reduce_fn_or_abort(datatype, op, comm);
+
+    // Upper bound on steps: ring needs 2(P-1), the chain and the trees 4 per segment plus 4 each, the others at most 2*log2(P) + 2
+    int max_steps = 2 * plan->size + 2 * 32 + 4;
+    if (algo == TREE_ALL_REDUCE || algo == LINEAR_ALL_REDUCE) max_steps = 4 * tree_nseg(count) + 4;
+    if (algo == DOUBLE_TREE_ALL_REDUCE) {
+        ll half = dbtree_split(count);
+        max_steps = 4 * (tree_nseg(half) + tree_nseg(count - half)) + 8;
+    }
+    plan->steps = (plan_step *) malloc(sizeof(plan_step) * max_steps);
+
+    switch (algo) {
+        case LINEAR_ALL_REDUCE:             build_linear(plan); break;
+        case RABENSEIFNER_ALL_REDUCE:       build_rabenseifner(plan); break;
+        case RING_ALL_REDUCE:               build_ring(plan); break;
+        case RECURSIVE_DOUBLING_ALL_REDUCE: build_recursive_doubling(plan); break;
+        case TREE_ALL_REDUCE:               build_tree(plan); break;
+        case DOUBLE_TREE_ALL_REDUCE:        build_double_tree(plan); break;
+        case RING_SEG_ALL_REDUCE:
+            // Its segments are pipelined across steps, which a step list cannot express;
+            // execute() hands it straight to ring_seg_allreduce. The nonblocking path
+            // runs the unsegmented ring schedule instead.
+            build_ring(plan);
+            break;
+        default:
+            fprintf(stderr, "allreduce_plan_create: unknown algorithm %d\n", algo);
+            MPI_Abort(comm, 1);
+    }
+
+    plan->scratch = (char *) reduce_alloc(plan->type_size * plan->scratch_len);
+    plan->reqs = (MPI_Request *) malloc(sizeof(MPI_Request) * 2 * (plan->nsteps > 0 ? plan->nsteps : 1));
+    plan->nreqs = (int *) calloc(plan->nsteps > 0 ? plan->nsteps : 1, sizeof(int));
+    plan->bound_buf = NULL;
+    plan->tag = PLAN_TAG;
+    plan->cur_step = plan->nsteps;
+    return plan;
+}
+
+void allreduce_plan_execute(allreduce_plan *plan, void *sendbuf, void *recvbuf) {
+    if (plan->algo == RING_SEG_ALL_REDUCE) {
+        ring_seg_allreduce(sendbuf, recvbuf, plan->count, plan->datatype, plan->op, plan->comm);
+        return;
+    }
+
+    char *recv_buf = (char*)recvbuf;
+    if (!IS_IN_PLACE(sendbuf, recvbuf)) {
+        memcpy(recv_buf, sendbuf, plan->count * plan->type_size);
+    }
+    if (plan->bound_buf != recvbuf) {
+        bind_requests(plan, recv_buf);
+    }
+
+    for (int i = 0; i < plan->nsteps; i++) {
+        plan_step *st = &plan->steps[i];
+        MPI_Request *req = &plan->reqs[2 * i];
+
+        MPI_Startall(plan->nreqs[i], req);
+        MPI_Waitall(plan->nreqs[i], req, MPI_STATUSES_IGNORE);
+
+        if (st->reduce) {
+            reduce_apply(plan->reduce, recv_buf + st->recv_off * plan->type_size, plan->scratch, st->recv_len, plan->type_size);
+        }
+    }
+}
+
+void allreduce_plan_start(allreduce_plan *plan, void *sendbuf, void *recvbuf) {
+    if (!IS_IN_PLACE(sendbuf, recvbuf)) {
+        memcpy(recvbuf, sendbuf, plan->count * plan->type_size);
+    }
+    if (plan->bound_buf != recvbuf) {
+        bind_requests(plan, (char *)recvbuf);
+    }
+    plan->cur_step = 0;
+    plan->step_started = 0;
+}
+
+int allreduce_plan_test(allreduce_plan *plan) {
+    char *recv_buf = (char *)plan->bound_buf;
+    while (plan->cur_step < plan->nsteps) {
+        int i = plan->cur_step;
+        MPI_Request *req = &plan->reqs[2 * i];
+        if (!plan->step_started) {
+            MPI_Startall(plan->nreqs[i], req);
+            plan->step_started = 1;
+        }
+
+        int flag;
+        MPI_Testall(plan->nreqs[i], req, &flag, MPI_STATUSES_IGNORE);
+        if (!flag) return 0;
+
+        plan_step *st = &plan->steps[i];
+        if (st->reduce) {
+            reduce_apply(plan->reduce, recv_buf + st->recv_off * plan->type_size, plan->scratch, st->recv_len, plan->type_size);
+        }
+        plan->cur_step++;
+        plan->step_started = 0;
+    }
+    return 1;
+}
+
+void allreduce_plan_free(allreduce_plan *plan) {
+    if (plan == NULL) return;
+    release_requests(plan);
+    free(plan->steps);
+    free(plan->scratch);
+    free(plan->reqs);
+    free(plan->nreqs);
+    free(plan);
+}
@@ -0,0 +1,64 @@
+#ifndef ALLREDUCE_PLAN_H
+#define ALLREDUCE_PLAN_H
+
+#include "macros.h"
+#include "reduce_ops.h"
+
+/**
+ * @brief Persistent allreduce plans.
+ *
+ * A plan fixes (comm, count, datatype, op, algo) once and precomputes the rank's whole
+ * communication schedule as a list of steps. It owns its scratch buffer and
+ * one pair of MPI persistent requests (MPI_Send_init/MPI_Recv_init) per step,
+ * so repeated executions do no allocation and no partner/offset arithmetic.
+ *
+ * Usage:
+ *     allreduce_plan *plan = allreduce_plan_create(comm, count, MPI_DOUBLE, MPI_SUM, RING_ALL_REDUCE);
+ *     for (...) allreduce_plan_execute(plan, sendbuf, recvbuf);
+ *     allreduce_plan_free(plan);
+ *
+ * allreduce_plan_start() / allreduce_plan_test() walk the same steps without
+ * blocking: test() advances as far as the completed requests allow and
+ * returns 1 once the last step is done (see suara_iallreduce.h).
+ */
+
+typedef struct {
+    int send_peer;          // -1 when the step sends nothing
+    ll send_off, send_len;  // region of recvbuf to send
+    int recv_peer;          // -1 when the step receives nothing
+    ll recv_off, recv_len;  // region of recvbuf the incoming data belongs to
+    int reduce;             // 1: land in scratch and combine into recvbuf, 0: land directly in recvbuf
+} plan_step;
+
+typedef struct {
+    MPI_Comm comm;
+    ll count;
+    MPI_Datatype datatype;
+    MPI_Op op;
+    int algo;                   // one of the *_ALL_REDUCE macros
+    int rank, size, type_size;
+    reduce_fn reduce;
+
+    int nsteps;
+    plan_step *steps;
+    char *scratch;              // landing buffer for reduce steps
+    ll scratch_len;             // in elements
+
+    MPI_Request *reqs;          // reqs[2*i], reqs[2*i+1]: persistent requests of step i (recv first)
+    int *nreqs;                 // number of live requests of step i
+    void *bound_buf;            // recvbuf the persistent requests currently point into
+    int tag;                    // message tag, PLAN_TAG unless set before the first execute/start
+
+    int cur_step;               // nonblocking progress: next step to finish
+    int step_started;           // its requests are in flight
+} allreduce_plan;
+
+#define PLAN_TAG 0
+
+allreduce_plan *allreduce_plan_create(MPI_Comm comm, ll count, MPI_Datatype datatype, MPI_Op op, int algo);
+void allreduce_plan_execute(allreduce_plan *plan, void *sendbuf, void *recvbuf);
+void allreduce_plan_start(allreduce_plan *plan, void *sendbuf, void *recvbuf);
+int allreduce_plan_test(allreduce_plan *plan);		//1 when the plan started last has completed
+void allreduce_plan_free(allreduce_plan *plan);
+
+#endif
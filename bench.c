@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <mpi.h>
+#include <math.h>
+#include <string.h>
+#include "est_time.h"
+#include "macros.h"
+#include "grid_allreduce.h"
+
+/**
+ * @brief Benchmark driver for the production allreduce kernels and the SUARA 2D path.
+ *
+ * Every (algorithm, message size) pair is run warmup times untimed and then
+ * iters times, each timed iteration starting from a barrier. The sample of an
+ * iteration is the slowest rank's time. Rank 0 reports min / median / p99 /
+ * mean next to the Hockney prediction, as CSV or JSON.
+ *
+ * Usage:
+ * 	smpirun -n <P> -platform platform.xml ./bench [options]
+ *
+ * Options:
+ * 	--sizes geom:<min>:<max>[:<factor>]	message sizes in doubles, min, min*factor, ... <= max (factor 2)
+ * 	--sizes lin:<min>:<max>:<step>		min, min+step, ... <= max; --sizes may be repeated
+ * 	--warmup <n>				untimed runs per point (default 5)
+ * 	--iters <n>				timed runs per point (default 50)
+ * 	--algos <list>				comma separated registry names (lin,rab,rnos,rs,rd,tree,dbt), suara,
+ * 						suara2d (the best Stage1_2d scheme), or all (default)
+ * 	--params <path>				alpha/beta/gamma for the predictions (default ./data_store/sample.csv)
+ * 	--seg <n>				segment size in doubles for rs, tree and dbt (default DEFAULT_SEG_SIZE)
+ * 	--format csv|json			(default csv)
+ * 	--out <path>				(default stdout)
+ */
+
+#define BENCH_SUARA NUM_ALGOS		//--algos index of the two-phase SUARA path
+#define BENCH_SUARA_2D (NUM_ALGOS + 1)	//--algos index of the Stage1_2d plan (any SCHEME_*)
+#define BENCH_ENTRIES (NUM_ALGOS + 2)
+#define BENCH_MAX_SIZES 4096
+
+typedef struct {
+    ll sizes[BENCH_MAX_SIZES];
+    int nsizes;
+    int warmup, iters;
+    int run[BENCH_ENTRIES];
+    char *params;
+    int json;
+    char *out;
+} bench_opts;
+
+static int bench_rank;
+
+// Every rank parses the same argv, so only rank 0 reports the problem
+static void bench_error(const char *fmt, const char *arg) {
+    if (bench_rank != 0) return;
+    fprintf(stderr, "bench: ");
+    fprintf(stderr, fmt, arg);
+    fprintf(stderr, "\n");
+}
+
+static int add_sizes(bench_opts *o, const char *spec) {
+    ll lo, hi, step = 2;
+    int geom;
+    if (sscanf(spec, "geom:%lld:%lld:%lld", &lo, &hi, &step) >= 2) geom = 1;
+    else if (sscanf(spec, "lin:%lld:%lld:%lld", &lo, &hi, &step) == 3) geom = 0;
+    else return 0;
+    if (lo < 1 || hi < lo || (geom ? step < 2 : step < 1)) return 0;
+
+    for (ll m = lo; m <= hi && o->nsizes < BENCH_MAX_SIZES; m = geom ? m * step : m + step)
+        o->sizes[o->nsizes++] = m;
+    return 1;
+}
+
+static int set_algos(bench_opts *o, const char *list) {
+    memset(o->run, 0, sizeof(o->run));
+    char *copy = strdup(list);
+    int ok = 1;
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+        int found = 0;
+        if (strcmp(tok, "all") == 0) {
+            for (int a = 0; a < BENCH_ENTRIES; a++) o->run[a] = 1;
+            found = 1;
+        }
+        if (strcmp(tok, "suara") == 0) {
+            o->run[BENCH_SUARA] = 1;
+            found = 1;
+        }
+        if (strcmp(tok, "suara2d") == 0) {
+            o->run[BENCH_SUARA_2D] = 1;
+            found = 1;
+        }
+        for (int a = 0; a < NUM_ALGOS; a++) {
+            if (strcmp(tok, algo_registry[a].name) == 0) {
+                o->run[a] = 1;
+                found = 1;
+            }
+        }
+        if (!found) {
+            bench_error("unknown algorithm '%s'", tok);
+            ok = 0;
+        }
+    }
+    free(copy);
+    return ok;
+}
+
+static int parse_args(int argc, char *argv[], bench_opts *o) {
+    o->nsizes = 0;
+    o->warmup = 5;
+    o->iters = 50;
+    o->params = "./data_store/sample.csv";
+    o->json = 0;
+    o->out = NULL;
+    set_algos(o, "all");
+
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            bench_error("%s needs a value", argv[i]);
+            return 0;
+        }
+        char *val = argv[++i];
+        if (strcmp(argv[i - 1], "--sizes") == 0) {
+            if (!add_sizes(o, val)) {
+                bench_error("bad size range '%s'", val);
+                return 0;
+            }
+        } else if (strcmp(argv[i - 1], "--warmup") == 0) o->warmup = atoi(val);
+        else if (strcmp(argv[i - 1], "--iters") == 0) o->iters = atoi(val);
+        else if (strcmp(argv[i - 1], "--algos") == 0) {
+            if (!set_algos(o, val)) return 0;
+        }
+        else if (strcmp(argv[i - 1], "--params") == 0) o->params = val;
+        else if (strcmp(argv[i - 1], "--seg") == 0) SEG_SIZE = atoll(val);
+        else if (strcmp(argv[i - 1], "--format") == 0) o->json = (strcmp(val, "json") == 0);
+        else if (strcmp(argv[i - 1], "--out") == 0) o->out = val;
+        else {
+            bench_error("unknown option %s", argv[i - 1]);
+            return 0;
+        }
+    }
+    if (o->nsizes == 0) add_sizes(o, "geom:1:1048576:4");
+    if (o->iters < 1 || o->warmup < 0 || SEG_SIZE < 1) {
+        bench_error("%s", "--iters must be >= 1, --warmup >= 0, --seg >= 1");
+        return 0;
+    }
+    return 1;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted sample
+static double percentile(const double *sorted, int n, double q) {
+    int k = (int)ceil(q * n) - 1;
+    if (k < 0) k = 0;
+    if (k > n - 1) k = n - 1;
+    return sorted[k];
+}
+
+typedef struct {
+    const char *name;
+    ll m;
+    char plan[64];
+    double predicted;
+    double min, median, p99, mean;
+    int ok;
+} bench_row;
+
+static void print_row(FILE *fp, const bench_opts *o, ll P, const bench_row *r, int first) {
+    if (o->json) {
+        fprintf(fp, "%s  {\"algo\": \"%s\", \"plan\": \"%s\", \"P\": %lld, \"m\": %lld, \"bytes\": %lld, "
+                    "\"warmup\": %d, \"iters\": %d, \"min\": %.9g, \"median\": %.9g, \"p99\": %.9g, "
+                    "\"mean\": %.9g, \"predicted\": %.9g, \"ok\": %d}",
+                first ? "" : ",\n", r->name, r->plan, P, r->m, r->m * (ll)sizeof(double),
+                o->warmup, o->iters, r->min, r->median, r->p99, r->mean, r->predicted, r->ok);
+    } else {
+        fprintf(fp, "%s,%s,%lld,%lld,%lld,%d,%d,%.9g,%.9g,%.9g,%.9g,%.9g,%d\n",
+                r->name, r->plan, P, r->m, r->m * (ll)sizeof(double),
+                o->warmup, o->iters, r->min, r->median, r->p99, r->mean, r->predicted, r->ok);
+    }
+    fflush(fp);
+}
+
+int main(int argc, char *argv[]) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    ll P = size;
+
+    bench_rank = rank;
+    my_init_algos();
+    bench_opts o;
+    int ok = parse_args(argc, argv, &o);
+    if (!ok) {
+        if (rank == 0) fprintf(stderr, "usage: bench [--sizes geom:min:max[:factor] | lin:min:max:step]... "
+                                       "[--warmup n] [--iters n] [--algos list] [--params path] [--seg n] "
+                                       "[--format csv|json] [--out path]\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Only rank 0 predicts, so only rank 0 needs the parameters
+    FILE *fp = stdout;
+    if (rank == 0) {
+        load_params(o.params);
+        if (o.out && !(fp = fopen(o.out, "w"))) {
+            fprintf(stderr, "bench: cannot write %s\n", o.out);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        if (o.json) fprintf(fp, "[\n");
+        else fprintf(fp, "algo,plan,P,m,bytes,warmup,iters,min,median,p99,mean,predicted,ok\n");
+    }
+
+    ll max_m = 0;
+    for (int s = 0; s < o.nsizes; s++) if (o.sizes[s] > max_m) max_m = o.sizes[s];
+    double *sendbuf = (double *) malloc(max_m * sizeof(double));
+    double *recvbuf = (double *) malloc(max_m * sizeof(double));
+    double *samples = (double *) malloc(o.iters * sizeof(double));
+    for (ll i = 0; i < max_m; i++) sendbuf[i] = rank + 1;
+    double expected = (double)P * (P + 1) / 2;
+
+    grid_cache grids;
+    grid_cache_init(&grids, MPI_COMM_WORLD);
+    int first = 1;
+
+    for (int a = 0; a < BENCH_ENTRIES; a++) {
+        if (!o.run[a] || (a < NUM_ALGOS && !algo_allowed(a, P))) continue;
+        for (int s = 0; s < o.nsizes; s++) {
+            ll m = o.sizes[s];
+            bench_row r;
+            r.m = m;
+
+            // The SUARA point runs the (row, col, Pc) plan Stage1 picks for this size
+            grid_comms *g = NULL;
+            ll plan_algos[2];
+            int scheme = SCHEME_FULL;
+            if (a == BENCH_SUARA_2D) {
+                ll ans[3];
+                r.name = "suara2d";
+                r.predicted = rank == 0 ? Stage1_2d(P, m, SEG_SIZE, ans, &scheme) : 0;
+                MPI_Bcast(ans, 3, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+                MPI_Bcast(&scheme, 1, MPI_INT, 0, MPI_COMM_WORLD);
+                plan_algos[0] = ans[0];
+                plan_algos[1] = ans[1];
+                g = grid_cache_get(&grids, ans[2]);
+                snprintf(r.plan, sizeof(r.plan), "%s%s/%s@%lld", scheme == SCHEME_RS ? "rs:" : scheme == SCHEME_DUAL ? "dual:" : "",
+                         algo_registry[ans[0]].name, algo_registry[ans[1]].name, ans[2]);
+            } else if (a == BENCH_SUARA) {
+                ll ans[3];
+                r.name = "suara";
+                r.predicted = Stage1_root(0, MPI_COMM_WORLD, P, m, SEG_SIZE, ans);
+                plan_algos[0] = ans[0];
+                plan_algos[1] = ans[1];
+                g = grid_cache_get(&grids, ans[2]);
+                snprintf(r.plan, sizeof(r.plan), "%s/%s@%lld", algo_registry[ans[0]].name, algo_registry[ans[1]].name, ans[2]);
+            } else {
+                r.name = algo_registry[a].name;
+                r.predicted = rank == 0 ? algo_time(a, P, m, SEG_SIZE) : 0;
+                snprintf(r.plan, sizeof(r.plan), "%s", r.name);
+            }
+
+            for (int it = 0; it < o.warmup + o.iters; it++) {
+                MPI_Barrier(MPI_COMM_WORLD);
+                double t0 = MPI_Wtime();
+                if (g) grid_allreduce_2d(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, g, plan_algos, scheme);
+                else algo[a](sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+                double t = MPI_Wtime() - t0, t_max;
+                MPI_Reduce(&t, &t_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+                if (it >= o.warmup) samples[it - o.warmup] = t_max;
+            }
+
+            // A timing is only reported as ok when the last run also reduced correctly everywhere
+            int mine = 1;
+            for (ll i = 0; i < m; i++) if (recvbuf[i] != expected) { mine = 0; break; }
+            MPI_Reduce(&mine, &r.ok, 1, MPI_INT, MPI_MIN, 0, MPI_COMM_WORLD);
+
+            if (rank == 0) {
+                qsort(samples, o.iters, sizeof(double), cmp_double);
+                double sum = 0;
+                for (int i = 0; i < o.iters; i++) sum += samples[i];
+                r.min = samples[0];
+                r.median = o.iters % 2 ? samples[o.iters / 2] : (samples[o.iters / 2 - 1] + samples[o.iters / 2]) / 2;
+                r.p99 = percentile(samples, o.iters, 0.99);
+                r.mean = sum / o.iters;
+                print_row(fp, &o, P, &r, first);
+                first = 0;
+            }
+        }
+    }
+
+    if (rank == 0) {
+        if (o.json) fprintf(fp, "\n]\n");
+        if (fp != stdout) fclose(fp);
+    }
+    grid_cache_free(&grids);
+    free(sendbuf);
+    free(recvbuf);
+    free(samples);
+    MPI_Finalize();
+    return 0;
+}
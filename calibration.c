@@ -0,0 +1,201 @@
+#include "calibration.h"
+#include "reduce_ops.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CALIB_MAX_SIZE (1LL << 18)		// largest message / reduction, in doubles
+#define CALIB_SIZE_STEP 4				// geometric step of every size sweep
+#define CALIB_MAX_POINTS 16
+#define CALIB_REPS 3					// timed repetitions per point; the minimum is kept
+
+// Solves the n x n system M y = v in place (Gaussian elimination, partial pivoting). 0 if singular.
+static int solve_small(double M[3][3], double *v, int n) {
+    for (int c = 0; c < n; c++) {
+        int piv = c;
+        for (int r = c + 1; r < n; r++)
+            if (fabs(M[r][c]) > fabs(M[piv][c])) piv = r;
+        if (fabs(M[piv][c]) < 1e-300) return 0;
+        if (piv != c) {
+            for (int k = 0; k < n; k++) { double t = M[c][k]; M[c][k] = M[piv][k]; M[piv][k] = t; }
+            double t = v[c]; v[c] = v[piv]; v[piv] = t;
+        }
+        for (int r = c + 1; r < n; r++) {
+            double f = M[r][c] / M[c][c];
+            for (int k = c; k < n; k++) M[r][k] -= f * M[c][k];
+            v[r] -= f * v[c];
+        }
+    }
+    for (int c = n - 1; c >= 0; c--) {
+        for (int k = c + 1; k < n; k++) v[c] -= M[c][k] * v[k];
+        v[c] /= M[c][c];
+    }
+    return 1;
+}
+
+// With at most 3 unknowns the active set can simply be enumerated: solve the unconstrained
+// problem on every subset of columns and keep the best non-negative solution.
+double nnls_small(const double *A, const double *b, int rows, int n, double *x) {
+    double best = -1;
+    for (int k = 0; k < n; k++) x[k] = 0;
+
+    for (int mask = 0; mask < (1 << n); mask++) {
+        int cols[3], nc = 0;
+        for (int k = 0; k < n; k++)
+            if (mask & (1 << k)) cols[nc++] = k;
+
+        double y[3] = {0, 0, 0};
+        if (nc > 0) {
+            double M[3][3] = {{0}};
+            for (int i = 0; i < nc; i++) {
+                for (int j = 0; j < nc; j++)
+                    for (int r = 0; r < rows; r++) M[i][j] += A[r * n + cols[i]] * A[r * n + cols[j]];
+                for (int r = 0; r < rows; r++) y[i] += A[r * n + cols[i]] * b[r];
+            }
+            if (!solve_small(M, y, nc)) continue;
+        }
+
+        int feasible = 1;
+        for (int i = 0; i < nc; i++)
+            if (y[i] < 0) feasible = 0;
+        if (!feasible) continue;
+
+        double rss = 0;
+        for (int r = 0; r < rows; r++) {
+            double e = -b[r];
+            for (int i = 0; i < nc; i++) e += A[r * n + cols[i]] * y[i];
+            rss += e * e;
+        }
+        if (best < 0 || rss < best) {
+            best = rss;
+            for (int k = 0; k < n; k++) x[k] = 0;
+            for (int i = 0; i < nc; i++) x[cols[i]] = y[i];
+        }
+    }
+    return best;
+}
+
+// Step 1: one-way time between ranks 0 and 1. fit[0] = alpha, fit[1] = beta (per double).
+static void pingpong(MPI_Comm comm, char *buf, double *fit) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    double A[CALIB_MAX_POINTS * 2], b[CALIB_MAX_POINTS];
+    int rows = 0;
+
+    for (ll m = 1; m <= CALIB_MAX_SIZE && rows < CALIB_MAX_POINTS; m *= CALIB_SIZE_STEP) {
+        double best = 1e30;
+        for (int rep = 0; rep <= CALIB_REPS; rep++) {
+            double t0 = MPI_Wtime();
+            if (rank == 0) {
+                MPI_Send(buf, m, MPI_DOUBLE, 1, 0, comm);
+                MPI_Recv(buf, m, MPI_DOUBLE, 1, 0, comm, MPI_STATUS_IGNORE);
+            } else if (rank == 1) {
+                MPI_Recv(buf, m, MPI_DOUBLE, 0, 0, comm, MPI_STATUS_IGNORE);
+                MPI_Send(buf, m, MPI_DOUBLE, 0, 0, comm);
+            }
+            double t = (MPI_Wtime() - t0) / 2;
+            if (rep > 0 && t < best) best = t;			// rep 0 is a warm-up
+        }
+        A[rows * 2] = 1;
+        A[rows * 2 + 1] = m;
+        b[rows++] = best;
+    }
+    if (rank == 0) nnls_small(A, b, rows, 2, fit);
+    MPI_Bcast(fit, 2, MPI_DOUBLE, 0, comm);
+}
+
+// Step 2: per-element combine time, the slowest rank's
+static double reduction_gamma(MPI_Comm comm, char *dst, char *src) {
+    reduce_fn reduce = get_reduce_fn_or_abort(MPI_DOUBLE, MPI_SUM, comm);
+    double A[CALIB_MAX_POINTS * 2], b[CALIB_MAX_POINTS];
+    int rows = 0;
+
+    for (ll n = 1024; n <= CALIB_MAX_SIZE && rows < CALIB_MAX_POINTS; n *= CALIB_SIZE_STEP) {
+        double best = 1e30;
+        for (int rep = 0; rep <= CALIB_REPS; rep++) {
+            double t0 = MPI_Wtime();
+            reduce_apply(reduce, dst, src, n, sizeof(double));
+            double t = MPI_Wtime() - t0;
+            if (rep > 0 && t < best) best = t;
+        }
+        // gamma_eff(gamma, n) is what the models charge, so fit gamma against n / speedup(n)
+        A[rows * 2] = 1;
+        A[rows * 2 + 1] = n * gamma_eff(1.0, n);
+        b[rows++] = best;
+    }
+    double fit[2];
+    nnls_small(A, b, rows, 2, fit);
+    double gamma;
+    MPI_Allreduce(&fit[1], &gamma, 1, MPI_DOUBLE, MPI_MAX, comm);
+    return gamma;
+}
+
+double calibrate(MPI_Comm comm, double budget, ll ms, double abg[3][NUM_ALGOS]) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    double start = MPI_Wtime();
+
+    char *send = (char *) reduce_alloc(CALIB_MAX_SIZE * sizeof(double));
+    char *recv = (char *) reduce_alloc(CALIB_MAX_SIZE * sizeof(double));
+    for (ll i = 0; i < CALIB_MAX_SIZE; i++) ((double *)send)[i] = 1.0;
+    memset(recv, 0, CALIB_MAX_SIZE * sizeof(double));
+
+    double link[2] = {0, 0};
+    if (size > 1) pingpong(comm, send, link);
+    double gamma = reduction_gamma(comm, recv, send);
+
+    for (int a = 0; a < NUM_ALGOS; a++) {
+        abg[0][a] = link[0];
+        abg[1][a] = link[1];
+        abg[2][a] = gamma;
+    }
+    if (size == 1) {
+        free(send); free(recv);
+        return MPI_Wtime() - start;
+    }
+
+    // Step 3: whatever budget is left is shared evenly by the algorithms. The budget left and
+    // the spend are both max-reduced times, so every rank stops at the same size.
+    double elapsed = MPI_Wtime() - start, remaining;
+    MPI_Allreduce(&elapsed, &remaining, 1, MPI_DOUBLE, MPI_MAX, comm);
+    remaining = budget - remaining;
+    double share = remaining > 0 ? remaining / NUM_ALGOS : 0;
+
+    for (int a = 0; a < NUM_ALGOS; a++) {
+        if (!algo_allowed(a, size)) continue;
+        algo_entry *e = &algo_registry[a];
+        double A[CALIB_MAX_POINTS * 2], b[CALIB_MAX_POINTS];
+        int rows = 0;
+        double spent = 0;
+
+        for (ll m = 1; m <= CALIB_MAX_SIZE && rows < CALIB_MAX_POINTS; m *= CALIB_SIZE_STEP) {
+            double best = 1e30, total = 0;
+            for (int rep = 0; rep <= CALIB_REPS; rep++) {
+                MPI_Barrier(comm);
+                double t0 = MPI_Wtime();
+                e->exec(send, recv, m, MPI_DOUBLE, MPI_SUM, comm);
+                double t = MPI_Wtime() - t0;
+                total += t;
+                if (rep > 0 && t < best) best = t;
+            }
+            double local[2] = {best, total}, slowest[2];
+            MPI_Allreduce(local, slowest, 2, MPI_DOUBLE, MPI_MAX, comm);
+            spent += slowest[1];
+
+            A[rows * 2] = e->cost(size, m, ms, 1, 0, 0);
+            A[rows * 2 + 1] = e->cost(size, m, ms, 0, 1, 0);
+            b[rows++] = slowest[0] - e->cost(size, m, ms, 0, 0, gamma);
+            // the next size costs about CALIB_SIZE_STEP times this one
+            if (spent + slowest[1] * CALIB_SIZE_STEP > share) break;
+        }
+        if (rows < 2) continue;
+
+        double fit[2];
+        nnls_small(A, b, rows, 2, fit);
+        abg[0][a] = fit[0];
+        abg[1][a] = fit[1];
+    }
+
+    free(send); free(recv);
+    return MPI_Wtime() - start;
+}
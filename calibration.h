@@ -0,0 +1,37 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include "macros.h"
+
+/**
+ * @brief In-job alpha/beta/gamma calibration.
+ *
+ * Replaces the offline run_linear_allreduce_series.sh + analyze_regression.py
+ * pipeline with three short measurements inside the job:
+ *   1. ping-pong between ranks 0 and 1 over a size sweep: alpha, beta of a
+ *      single link (fit T = alpha + beta*m);
+ *   2. a local reduce_apply sweep on every rank: gamma (slowest rank wins);
+ *   3. every registered algorithm over comm at a few sizes: its own alpha and
+ *      beta, fitted against its Hockney model with gamma held at (2).
+ *
+ * Every Hockney model is linear in (alpha, beta, gamma), so step 3 uses the
+ * features cost(P, m, ms, 1, 0, 0), cost(P, m, ms, 0, 1, 0) and
+ * cost(P, m, ms, 0, 0, 1). beta and gamma features both grow with m, which is
+ * why gamma comes from step 2 instead of being fitted alongside beta.
+ * All fits are non-negative least squares. An algorithm that cannot be
+ * fitted (P == 1, or too few sizes within the budget) keeps the ping-pong
+ * alpha and beta.
+ *
+ * Collective over comm; every rank gets the same abg.
+ */
+
+#define DEFAULT_CALIBRATION_BUDGET 0.3			//seconds
+
+// Fills abg[i][j] (i: alpha, beta, gamma; j: algorithm) for doubles and MPI_SUM; returns seconds spent
+double calibrate(MPI_Comm comm, double budget, ll ms, double abg[3][NUM_ALGOS]);
+
+// Non-negative least squares for n <= 3 unknowns: minimises |A x - b| with x >= 0.
+// A is rows x n, row-major. Returns the residual sum of squares.
+double nnls_small(const double *A, const double *b, int rows, int n, double *x);
+
+#endif
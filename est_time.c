@@ -6,35 +6,90 @@
 #include<stdio.h>
 #include<stdlib.h>
 #include"macros.h"
-#include"./utils/all_combos.h"			//Declares lin_lin, lin_rab, and similar 25 functions
+#include"./utils/hockneytime_lin.h"
+#include"./utils/hockneytime_rab.h"
+#include"./utils/hockneytime_rnos.h"
+#include"./utils/hockneytime_rs.h"
+#include"./utils/hockneytime_rd.h"
+#include"./utils/hockneytime_shm.h"
+#include"./utils/hockneytime_bcast.h"
+#include"./utils/hockneytime_tree.h"
+#include"./utils/hockneytime_dbt.h"
 #include<string.h>
 #include "linear_allreduce.h"
 #include "rabenseifner_allreduce.h"
 #include "ring_allreduce.h"
 #include "ring_seg_allreduce.h"
 #include "recursive_doubling_allreduce.h"
+#include "tree_allreduce.h"
+#include "topo_allreduce.h"
+#include "grid_allreduce.h"
+#include "reduce_ops.h"
+#include "stage1_cache.h"
 //#define LINEAR_ALL_REDUCE 0
 //#define RABENSEIFNER_ALL_REDUCE 1
 //#define RING_ALL_REDUCE 2
 //#define RING_SEG_ALL_REDUCE 3
 //#define RECURSIVE_DOUBLING_ALL_REDUCE 4
+//#define TREE_ALL_REDUCE 5
+//#define DOUBLE_TREE_ALL_REDUCE 6
 
 
 #define MAX_FIELD 256
 
 
-getTimeandPc func[NUM_ALGOS][NUM_ALGOS];					//func[i][j] estimates the time taken when using algorithm i for rows and j for columns
 execAllReduce algo[NUM_ALGOS];									//algo[i] stores the function pointer that implements the algorithm defined by the macro i
 
+//Everything Stage1 knows about each algorithm
+algo_entry algo_registry[NUM_ALGOS] = {
+	[LINEAR_ALL_REDUCE]				= {"lin",	hockneytime_lin,	linear_allreduce,				0,	NULL,							NULL,					0,	0},
+	[RABENSEIFNER_ALL_REDUCE]		= {"rab",	hockneytime_rab,	rabenseifner_allreduce,			0,	rabenseifner_reduce_scatter,	rabenseifner_allgather,	1,	1},
+	[RING_ALL_REDUCE]				= {"rnos",	hockneytime_rnos,	ring_allreduce,					0,	ring_reduce_scatter,			ring_allgather,			0,	1},
+	[RING_SEG_ALL_REDUCE]			= {"rs",	hockneytime_rs,		ring_seg_allreduce,				0,	NULL,							NULL,					0,	0},
+	[RECURSIVE_DOUBLING_ALL_REDUCE]	= {"rd",	hockneytime_rd,		recursive_doubling_allreduce,	0,	NULL,							NULL,					0,	1},
+	[TREE_ALL_REDUCE]				= {"tree",	hockneytime_tree,	tree_allreduce,					0,	NULL,							NULL,					0,	0},
+	[DOUBLE_TREE_ALL_REDUCE]		= {"dbt",	hockneytime_dbt,	double_tree_allreduce,			0,	NULL,							NULL,					0,	0},
+};
+
 double alpha_beta_gamma[3][NUM_ALGOS];						//alpha_beta_gamma[i][j] stores alpha, beta, gamma values for algorithm j
+double alpha_beta_gamma_intra[3][NUM_ALGOS];				//same, measured between ranks of one node (my_init_intra)
+double alpha_beta_gamma_shm[3];								//alpha, beta, gamma of the shared-memory reduce-scatter/allgather
 
 
-//Initialises our simulation by reading alpha, beta, gamma and loading function pointer tables
-void my_init(char path[]){
+//Loads the function pointer tables. Needs no file, so every rank can call it.
+void my_init_algos(){
+	//assign algo elements here
+	for(int k=0; k<NUM_ALGOS; k++)
+		algo[k] = algo_registry[k].exec;
+}
+
+//until my_init_intra is called, assume node-local links behave like the network
+static void derive_level_params(){
+	memcpy(alpha_beta_gamma_intra, alpha_beta_gamma, sizeof(alpha_beta_gamma));
+	for(int k=0; k<3; k++)
+		alpha_beta_gamma_shm[k] = alpha_beta_gamma[k][RING_ALL_REDUCE];
+}
+
+//Registry index of an algorithm's csv name, -1 if there is none
+static int algo_index(const char *name){
+	for(int i=0; i<NUM_ALGOS; i++)
+		if(strcmp(name, algo_registry[i].name) == 0)
+			return i;
+	return -1;
+}
+
+//Reads alpha, beta, gamma from a csv. Returns 0 (and leaves the parameters alone) if path cannot be opened.
+//Rows are matched to algorithms by name; an algorithm the file has no row for (e.g. one added after
+//the file was measured) gets alpha = 1e10, so Stage1 never picks it on made-up parameters.
+int load_params(char path[]){
     //1. read alpha beta and gamma from a csv
     FILE*fp = fopen(path, "r");
+    if(fp == NULL){
+		fprintf(stderr, "load_params: cannot open %s\n", path);
+		return 0;
+	}
     char line[256];
-    int i = 0;
+    int seen[NUM_ALGOS] = {0};
 
     // Skip header line
     fgets(line, sizeof(line), fp);
@@ -42,18 +97,23 @@ void my_init(char path[]){
 	// printf("%-30s | %-20s %-20s %-20s\n", "Algorithm", "Alpha", "Beta", "Gamma");
 	// printf("-------------------------------------------------------------\n");
 
-	while (fgets(line, sizeof(line), fp) && i < NUM_ALGOS) {
+	while (fgets(line, sizeof(line), fp)) {
 		char algo[MAX_FIELD];
 		double a, b, c;
 
 		if (sscanf(line, "%[^,],%lf,%lf,%lf", algo, &a, &b, &c) == 4) {
+			int i = algo_index(algo);
+			if (i < 0) {
+				fprintf(stderr, "load_params: %s: unknown algorithm %s\n", path, algo);
+				continue;
+			}
 			alpha_beta_gamma[0][i] = a;
 			alpha_beta_gamma[1][i] = b;
 			alpha_beta_gamma[2][i] = c;
+			seen[i] = 1;
 
 			// Pretty formatted row
 			// printf("%-15s | %-10.4f %-10.4f %-10.4f\n", algo, a, b, c);
-			i++;
 		}
 	}
 
@@ -63,48 +123,194 @@ void my_init(char path[]){
     fclose(fp);
 	//2. Code for reading alpha, beta, gamma ends here
 
-	//CHANGES NEEDED
-	//assign all function pointers
-	func[0][0] = lin_lin;
-	func[0][1] = lin_rab;
-	func[0][2] = lin_rnos;
-	func[0][3] = lin_rs;
-	func[0][4] = lin_rd;	
-
-	func[1][0] = rab_lin;
-	func[1][1] = rab_rab;
-	func[1][2] = rab_rnos;
-	func[1][3] = rab_rs;
-	func[1][4] = rab_rd;	
-
-	func[2][0] = rnos_lin;
-	func[2][1] = rnos_rab;
-	func[2][2] = rnos_rnos;
-	func[2][3] = rnos_rs;
-	func[2][4] = rnos_rd;
-
-	func[3][0] = rs_lin;
-	func[3][1] = rs_rab;
-	func[3][2] = rs_rnos;
-	func[3][3] = rs_rs;
-	func[3][4] = rs_rd;
-
-	func[4][0] = rd_lin;
-	func[4][1] = rd_rab;
-	func[4][2] = rd_rnos;
-	func[4][3] = rd_rs;
-	func[4][4] = rd_rd;
+	for (int i = 0; i < NUM_ALGOS; i++) {
+		if (seen[i]) continue;
+		fprintf(stderr, "load_params: %s has no row for %s, it will not be selected\n", path, algo_registry[i].name);
+		alpha_beta_gamma[0][i] = 1e10;
+		alpha_beta_gamma[1][i] = 0;
+		alpha_beta_gamma[2][i] = 0;
+	}
 
-	//assign algo elements here
-	algo[LINEAR_ALL_REDUCE] = linear_allreduce;
-	algo[RABENSEIFNER_ALL_REDUCE] = rabenseifner_allreduce;
-	algo[RING_ALL_REDUCE] = ring_allreduce;
-	algo[RING_SEG_ALL_REDUCE] = ring_seg_allreduce;
-	algo[RECURSIVE_DOUBLING_ALL_REDUCE] = recursive_doubling_allreduce;
+	derive_level_params();
+	return 1;
+}
 
+//Installs alpha, beta, gamma measured in the job (see calibration.h)
+void set_params(double abg[3][NUM_ALGOS]){
+	memcpy(alpha_beta_gamma, abg, sizeof(alpha_beta_gamma));
+	derive_level_params();
+}
+
+void get_params(double abg[3][NUM_ALGOS]){
+	memcpy(abg, alpha_beta_gamma, sizeof(alpha_beta_gamma));
+}
+
+//Writes the current alpha, beta, gamma in the layout load_params reads
+int save_params(char path[]){
+	FILE*fp = fopen(path, "w");
+	if(fp == NULL){
+		fprintf(stderr, "save_params: cannot write %s\n", path);
+		return 0;
+	}
+	fprintf(fp, "algo,alpha,beta,gamma\n");
+	for(int i=0; i<NUM_ALGOS; i++)
+		fprintf(fp, "%s,%.9g,%.9g,%.9g\n", algo_registry[i].name, alpha_beta_gamma[0][i], alpha_beta_gamma[1][i], alpha_beta_gamma[2][i]);
+	fclose(fp);
+	return 1;
+}
+
+//Initialises our simulation by reading alpha, beta, gamma and loading function pointer tables
+void my_init(char path[]){
+	my_init_algos();
+	load_params(path);
 	// printf("Init Done!\n");
 }
 
+//Reads the intra-node alpha, beta, gamma (same layout as my_init's csv plus an optional "shm" row).
+//Call after my_init.
+void my_init_intra(char path[]){
+	FILE*fp = fopen(path, "r");
+	if(fp == NULL){
+		fprintf(stderr, "my_init_intra: cannot open %s, keeping inter-node parameters\n", path);
+		return;
+	}
+	char line[256];
+
+	// Skip header line; algorithms without a row keep their inter-node parameters
+	fgets(line, sizeof(line), fp);
+	while (fgets(line, sizeof(line), fp)) {
+		char name[MAX_FIELD];
+		double a, b, c;
+
+		if (sscanf(line, "%[^,],%lf,%lf,%lf", name, &a, &b, &c) != 4)
+			continue;
+		int i = algo_index(name);
+		if (strcmp(name, "shm") == 0) {
+			alpha_beta_gamma_shm[0] = a;
+			alpha_beta_gamma_shm[1] = b;
+			alpha_beta_gamma_shm[2] = c;
+		} else if (i >= 0) {
+			alpha_beta_gamma_intra[0][i] = a;
+			alpha_beta_gamma_intra[1][i] = b;
+			alpha_beta_gamma_intra[2][i] = c;
+		}
+	}
+	fclose(fp);
+}
+
+//FNV-1a over everything Stage1's answer depends on besides (P, m): the parameters, ms, the
+//algorithm set and the thread count gamma_eff assumes. Keys Stage1_cached's decisions.
+unsigned long long calibration_fingerprint(ll ms){
+	unsigned long long h = 1469598103934665603ULL;
+	#define FNV_MIX(ptr, len) \
+		for(size_t b_=0; b_<(len); b_++){ h ^= ((const unsigned char *)(ptr))[b_]; h *= 1099511628211ULL; }
+	int threads = reduce_threads(REDUCE_MT_THRESHOLD);
+	int nalgos = NUM_ALGOS;
+	FNV_MIX(alpha_beta_gamma, sizeof(alpha_beta_gamma));
+	FNV_MIX(&ms, sizeof(ms));
+	FNV_MIX(&threads, sizeof(threads));
+	FNV_MIX(&nalgos, sizeof(nalgos));
+	#undef FNV_MIX
+	return h;
+}
+
+int algo_allowed(int i, ll P){
+	return !algo_registry[i].pow2_only || (P & (P-1)) == 0;
+}
+
+//Predicted time of one algorithm over all P ranks, 1e10 when it cannot run on P
+double algo_time(int a, ll P, ll m, ll ms){
+	if(!algo_allowed(a, P)) return 1e10;
+	return algo_registry[a].cost(P, m, ms, alpha_beta_gamma[0][a], alpha_beta_gamma[1][a], alpha_beta_gamma[2][a]);
+}
+
+static int cmp_stage1_entry(const void *a, const void *b){
+	double ta = ((const stage1_entry *)a)->time, tb = ((const stage1_entry *)b)->time;
+	return (ta > tb) - (ta < tb);
+}
+
+//The plan an entry actually runs, in one canonical form: an algorithm over a 1-rank dimension does
+//nothing, so a grid with a dimension of 1 is the 1D allreduce {a, a, 1}; and {row, col, Pc} with
+//{col, row, P/Pc} cost the same, so the mirror with the smaller row dimension stands for both
+static void effective_plan(stage1_entry *e, ll P){
+	if(e->Pc == 1 || e->Pc == P){
+		int a = (e->Pc == 1) ? e->col : e->row;
+		e->row = e->col = a;
+		e->Pc = 1;
+		return;
+	}
+	ll Pr = P/e->Pc;
+	if(Pr < e->Pc || (Pr == e->Pc && e->col < e->row)){
+		int t = e->row;
+		e->row = e->col;
+		e->col = t;
+		e->Pc = Pr;
+	}
+}
+
+//Scores every (row algo, column algo, Pc) over all factors Pc of P in one pass.
+//table (NUM_ALGOS*NUM_ALGOS entries) receives distinct effective plans (effective_plan), fastest
+//first, so no two entries run the same allreduce; the remaining entries get time 1e10.
+//times41[i][j] still holds pair (i, j)'s best time over every Pc. Returns the best time.
+double Stage1_ranked(ll P, ll m, ll ms, stage1_entry *table){
+	find_and_store_factors(P);				//Finds the factors for P in factorsP[] array which is a global variable
+
+	//each algorithm is costed once per factor, over Pc ranks (rows) and over P/Pc ranks (columns)
+	double *row_t = malloc(sizeof(double) * NUM_ALGOS * NUM_FACTORS);
+	double *col_t = malloc(sizeof(double) * NUM_ALGOS * NUM_FACTORS);
+	for(int a=0; a<NUM_ALGOS; a++){
+		algo_entry *e = &algo_registry[a];
+		double al = alpha_beta_gamma[0][a], be = alpha_beta_gamma[1][a], ga = alpha_beta_gamma[2][a];
+		for(int f=0; f<NUM_FACTORS; f++){
+			ll Pc = factorsP[f];
+			row_t[a*NUM_FACTORS + f] = algo_allowed(a, Pc) ? e->cost(Pc, m, ms, al, be, ga) : 1e10;
+			col_t[a*NUM_FACTORS + f] = algo_allowed(a, P/Pc) ? e->cost(P/Pc, m, ms, al, be, ga) : 1e10;
+		}
+	}
+
+	//every (i, j, Pc) as its effective plan
+	int ncand = 0;
+	stage1_entry *cand = malloc(sizeof(stage1_entry) * NUM_ALGOS * NUM_ALGOS * NUM_FACTORS);
+	for(int i=0; i<NUM_ALGOS; i++){
+		for(int j=0; j<NUM_ALGOS; j++){
+			times41[i][j] = 1e10;
+			for(int f=0; f<NUM_FACTORS; f++){
+				double t = row_t[i*NUM_FACTORS + f] + col_t[j*NUM_FACTORS + f];
+				if(t < times41[i][j])
+					times41[i][j] = t;
+				if(t >= 1e10)
+					continue;
+				stage1_entry *c = &cand[ncand++];
+				c->row = i;
+				c->col = j;
+				c->Pc = factorsP[f];
+				c->time = t;
+				effective_plan(c, P);
+			}
+		}
+	}
+	free(row_t);
+	free(col_t);
+
+	//fastest first, then keep the first entry of every plan
+	qsort(cand, ncand, sizeof(stage1_entry), cmp_stage1_entry);
+	int n = 0;
+	for(int c=0; c<ncand && n<NUM_ALGOS*NUM_ALGOS; c++){
+		int seen = 0;
+		for(int k=0; k<n && !seen; k++)
+			seen = (table[k].row == cand[c].row && table[k].col == cand[c].col && table[k].Pc == cand[c].Pc);
+		if(!seen)
+			table[n++] = cand[c];
+	}
+	free(cand);
+	for(; n<NUM_ALGOS*NUM_ALGOS; n++){
+		table[n].row = table[n].col = 0;
+		table[n].Pc = P;
+		table[n].time = 1e10;
+	}
+	return table[0].time;
+}
+
 //Finds the optimal algorithm for a given set of parameters
 double Stage1(ll P, ll m, ll ms, ll * ans){				//ans is a (1x3) array that stores 3 things: ans[0] stores optimal row algo, ans[1] stores optimal column algo, while ans[2] stores optimal Pc value
 	//recall that Pc is the number of columns
@@ -113,54 +319,280 @@ double Stage1(ll P, ll m, ll ms, ll * ans){				//ans is a (1x3) array that store
 	/*
 		Before calling this you must call my_init!!
 	*/
+	stage1_entry table[NUM_ALGOS*NUM_ALGOS];
+	double min_time = Stage1_ranked(P, m, ms, table);
 
-	//debug:
-	// sleep(1);
-	// printf("init done inside stage1\n");
-	// printf("Stage1 called\n");
-	double min_time = 1e10;
-	find_and_store_factors(P);				//Finds the factors for P in factorsP[] array which is a global variable
-	ll Pc_opt = P;
-	int algorow_opt = 0, algocol_opt = 0;
-	
 	if(ans == NULL)
 		ans = malloc(3*sizeof(ll));
 	//assume that ans already has space
 	//that is just a fallback
-	
-	
-	for(int i=0; i<NUM_ALGOS; i++){
-		for(int j=0; j<NUM_ALGOS; j++){
-			ll * pc_cand = malloc(1*sizeof(ll));			//pc_cand stands for pc_candidate
-			// printf("going to call a function %d %d\n", i, j);
-			double time_taken_predicted = func[i][j](P, m, ms, alpha_beta_gamma,pc_cand);
-			// double time_taken_actual;
 
+	ans[0] = table[0].row;
+	ans[1] = table[0].col;
+	ans[2] = table[0].Pc;
+	return min_time;
+}
 
 
-			//start time
-			//initialisation of sendbuf, recvbuf, and other variables
+//Largest shard algorithm a's reduce_scatter leaves on one of P ranks
+static ll rs_shard(int a, ll P, ll m){
+	ll core = P;
+	if(algo_registry[a].rs_pow2_core){
+		core = 1;
+		while(core*2 <= P)
+			core *= 2;
+	}
+	return (m + core - 1)/core;
+}
 
-			// algo[i](const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
-			//end_time
-			//time_taken = end_time() - start_time()
-			
-			if(time_taken_predicted < min_time){
-				algorow_opt = i;
-				algocol_opt = j;
-				Pc_opt = *pc_cand;
-				min_time = time_taken_predicted;
-			}	
-		}	
+//algo_time with only the link terms (alpha, beta) or only the combine term (gamma)
+static double algo_part(int a, ll P, ll m, ll ms, int link, int combine){
+	if(!algo_allowed(a, P)) return 1e10;
+	return algo_registry[a].cost(P, m, ms, link ? alpha_beta_gamma[0][a] : 0, link ? alpha_beta_gamma[1][a] : 0,
+								 combine ? alpha_beta_gamma[2][a] : 0);
+}
+
+//Predicted time of one 2D scheme with row over Pc ranks and col over P/Pc ranks, 1e10 if it cannot run.
+//SCHEME_RS: row's reduce-scatter and allgather together are exactly its allreduce, so the registry
+//model prices both; the column only allreduces the largest row shard, Pc (or its power-of-2 core)
+//times less than SCHEME_FULL's column.
+//SCHEME_DUAL: each half crosses a row and a column of m/2 elements, one half on the row links while
+//the other is on the column links. Row and column traffic are assumed to take disjoint paths (as on
+//a fat tree), but each link set still carries both halves, so the link terms are twice the slower
+//dimension's for m/2: close to half of SCHEME_FULL when the two are balanced. The combines of both
+//halves share the rank's cores, so gamma is paid for all of m. It is never picked when one dimension
+//is 1 (nothing to overlap), and only for algorithms whose allreduce_plan runs exactly the schedule
+//their model prices (plan_exact): the halves run as step lists, where rs is an unsegmented ring, dbt's
+//trees run one after the other and tree/lin advance one segment per poll.
+double scheme_time(int scheme, int row, int col, ll P, ll Pc, ll m, ll ms){
+	if(!algo_allowed(row, Pc) || !algo_allowed(col, P/Pc))
+		return 1e10;
+	switch(scheme){
+		case SCHEME_FULL:
+			return algo_time(row, Pc, m, ms) + algo_time(col, P/Pc, m, ms);
+		case SCHEME_RS:
+			if(algo_registry[row].reduce_scatter == NULL)
+				return 1e10;
+			return algo_time(row, Pc, m, ms) + algo_time(col, P/Pc, rs_shard(row, Pc, m), ms);
+		case SCHEME_DUAL: {
+			if(Pc == 1 || Pc == P || !algo_registry[row].plan_exact || !algo_registry[col].plan_exact)
+				return 1e10;
+			ll half = (m + 1)/2;
+			double row_link = algo_part(row, Pc, half, ms, 1, 0), col_link = algo_part(col, P/Pc, half, ms, 1, 0);
+			double combine = algo_part(row, Pc, half, ms, 0, 1) + algo_part(col, P/Pc, half, ms, 0, 1);
+			return 2*(row_link > col_link ? row_link : col_link) + 2*combine;
+		}
+	}
+	return 1e10;
+}
+
+//Stage1 over every 2D scheme: ans as in Stage1, *scheme the SCHEME_* that goes with it
+double Stage1_2d(ll P, ll m, ll ms, ll * ans, int *scheme){
+	find_and_store_factors(P);
+	double min_time = 1e10;
+	ans[0] = ans[1] = 0;
+	ans[2] = P;
+	*scheme = SCHEME_FULL;
+	for(int s=0; s<NUM_SCHEMES; s++){
+		for(int f=0; f<NUM_FACTORS; f++){
+			ll Pc = factorsP[f];
+			for(int i=0; i<NUM_ALGOS; i++){
+				for(int j=0; j<NUM_ALGOS; j++){
+					double t = scheme_time(s, i, j, P, Pc, m, ms);
+					if(t < min_time){
+						min_time = t;
+						ans[0] = i;
+						ans[1] = j;
+						ans[2] = Pc;
+						*scheme = s;
+					}
+				}
+			}
+		}
 	}
-	
-	ans[0] = algorow_opt;
-	ans[1] = algocol_opt;
-	ans[2] = Pc_opt;
 	return min_time;
 }
 
 
+//The decision Stage1_root broadcasts
+typedef struct {
+	ll ans[3];
+	double time;
+} packed_decision;
+
+//Stage1 run once: root (which must have loaded the parameters) decides through Stage1_cached and
+//broadcasts the decision, so every rank of comm runs the same configuration.
+double Stage1_root(int root, MPI_Comm comm, ll P, ll m, ll ms, ll * ans){
+	int rank;
+	MPI_Comm_rank(comm, &rank);
+	packed_decision d;
+	if(rank == root)
+		d.time = Stage1_cached(P, m, ms, d.ans);
+	MPI_Bcast(&d, sizeof(d), MPI_BYTE, root, comm);
+	memcpy(ans, d.ans, sizeof(d.ans));
+	return d.time;
+}
+
+
+//Topology-aware variant of Stage1: ppn ranks on each of nodes nodes.
+//ans[0] is the intra-node algorithm (a *_ALL_REDUCE macro or INTRA_SHM), ans[1] the inter-node algorithm.
+//Each level is scored with its own alpha, beta, gamma, for the path topo_allreduce takes:
+//on uniform nodes an intra algorithm with a reduce-scatter (and INTRA_SHM) sends only its largest
+//shard across nodes, between its reduce-scatter and allgather (together priced as its allreduce);
+//every other case reduces in the node, runs the inter level on the leaders alone and broadcasts.
+//uniform = 0 is for nodes with different rank counts (ppn is then the largest): every intra algorithm
+//takes the leader path there, and INTRA_SHM is never returned since it falls back to the ring.
+double Stage1_topo(ll nodes, ll ppn, ll m, ll ms, int uniform, ll * ans){
+	double min_time = 1e10;
+	ll intra_opt = uniform ? INTRA_SHM : RING_ALL_REDUCE, inter_opt = 0;
+	//the broadcast is point-to-point forwarding, priced with the intra-node linear chain's alpha and beta
+	double t_bcast = hockneytime_bcast(ppn, m, ms, alpha_beta_gamma_intra[0][LINEAR_ALL_REDUCE],
+									   alpha_beta_gamma_intra[1][LINEAR_ALL_REDUCE], 0);
+
+	for(int j=0; j<NUM_ALGOS; j++){
+		if(!algo_allowed(j, nodes))
+			continue;
+		double aj = alpha_beta_gamma[0][j], bj = alpha_beta_gamma[1][j], gj = alpha_beta_gamma[2][j];
+		double t_inter_full = algo_registry[j].cost(nodes, m, ms, aj, bj, gj);
+
+		for(int i=0; i<NUM_ALGOS; i++){
+			if(!algo_allowed(i, ppn))
+				continue;
+			double t = algo_registry[i].cost(ppn, m, ms, alpha_beta_gamma_intra[0][i], alpha_beta_gamma_intra[1][i], alpha_beta_gamma_intra[2][i]);
+			if(uniform && algo_registry[i].reduce_scatter != NULL)
+				t += algo_registry[j].cost(nodes, rs_shard(i, ppn, m), ms, aj, bj, gj);
+			else
+				t += t_inter_full + t_bcast;
+			if(t < min_time){
+				min_time = t;
+				intra_opt = i;
+				inter_opt = j;
+			}
+		}
+
+		//shared-memory reduce-scatter, shard-only inter level, shared-memory allgather
+		if(!uniform)
+			continue;
+		double t = hockneytime_shm(ppn, m, ms, alpha_beta_gamma_shm[0], alpha_beta_gamma_shm[1], alpha_beta_gamma_shm[2])
+				 + algo_registry[j].cost(nodes, (m + ppn - 1)/ppn, ms, aj, bj, gj);
+		if(t < min_time){
+			min_time = t;
+			intra_opt = INTRA_SHM;
+			inter_opt = j;
+		}
+	}
+
+	ans[0] = intra_opt;
+	ans[1] = inter_opt;
+	return min_time;
+}
+
+
+//State of one Stage1_kd search: every divisor of P with its best single-dimension algorithm
+typedef struct {
+	int ndiv;
+	ll *div;
+	double *cost;
+	ll *best_algo;
+	int kmax;
+	int cur[MAX_GRID_DIMS];
+	double best_time;
+	int best_depth;
+	int best[MAX_GRID_DIMS];
+} kd_search;
+
+//Extends the partial factorization cur[0..depth) with factors >= div[start] whose product is rest
+static void kd_extend(kd_search *s, ll rest, int start, int depth, double t){
+	if(rest == 1){
+		if(t < s->best_time){
+			s->best_time = t;
+			s->best_depth = depth;
+			memcpy(s->best, s->cur, depth*sizeof(int));
+		}
+		return;
+	}
+	if(depth == s->kmax)
+		return;
+
+	for(int i=start; i<s->ndiv; i++){
+		ll d = s->div[i];
+		if(d > rest)
+			break;
+		if(rest % d != 0)
+			continue;
+		//factors are non-decreasing, so what is left must be 1 or at least d
+		if(d != rest && rest/d < d)
+			continue;
+		//every dimension costs >= 0: no completion of this prefix can win
+		if(t + s->cost[i] >= s->best_time)
+			continue;
+		s->cur[depth] = i;
+		kd_extend(s, rest/d, i, depth+1, t + s->cost[i]);
+	}
+}
+
+//k-dimensional Stage1: splits P into up to kmax factors dims[0] x ... x dims[ndims-1] and picks
+//an algorithm per dimension (algos[d] runs over dims[d] ranks; see grid_allreduce.h).
+//
+//Every dimension reduces the full m elements, so the time is a sum of independent per-dimension
+//terms: each factor's best algorithm is computed once, and permutations of the same factors all
+//cost the same, so only non-decreasing factor sequences are searched. Branches whose partial sum
+//already exceeds the best complete split are cut.
+double Stage1_kd(ll P, ll m, ll ms, int kmax, ll *dims, ll *algos, int *ndims){
+	if(kmax > MAX_GRID_DIMS)
+		kmax = MAX_GRID_DIMS;
+
+	kd_search s;
+	s.div = malloc(sizeof(ll) * (2*sqrt((double)P) + 2));
+	s.ndiv = 0;
+	//divisors > 1 in increasing order
+	ll *hi = malloc(sizeof(ll) * (sqrt((double)P) + 2));
+	ll nhi = 0;
+	for(ll i=2; i*i<=P; i++){
+		if(P % i == 0){
+			s.div[s.ndiv++] = i;
+			if(i != P/i)
+				hi[nhi++] = P/i;
+		}
+	}
+	while(nhi > 0)
+		s.div[s.ndiv++] = hi[--nhi];
+	if(P > 1)
+		s.div[s.ndiv++] = P;
+	free(hi);
+
+	s.cost = malloc(sizeof(double) * (s.ndiv + 1));
+	s.best_algo = malloc(sizeof(ll) * (s.ndiv + 1));
+	for(int i=0; i<s.ndiv; i++){
+		s.cost[i] = 1e10;
+		s.best_algo[i] = 0;
+		for(int a=0; a<NUM_ALGOS; a++){
+			if(!algo_allowed(a, s.div[i]))
+				continue;
+			double t = algo_registry[a].cost(s.div[i], m, ms, alpha_beta_gamma[0][a], alpha_beta_gamma[1][a], alpha_beta_gamma[2][a]);
+			if(t < s.cost[i]){
+				s.cost[i] = t;
+				s.best_algo[i] = a;
+			}
+		}
+	}
+
+	s.kmax = kmax;
+	s.best_time = 1e10;
+	s.best_depth = 0;
+	kd_extend(&s, P, 0, 0, 0.0);
+
+	*ndims = s.best_depth;
+	for(int d=0; d<s.best_depth; d++){
+		dims[d] = s.div[s.best[d]];
+		algos[d] = s.best_algo[s.best[d]];
+	}
+
+	free(s.div); free(s.cost); free(s.best_algo);
+	return s.best_time;
+}
+
+
 // %-15s | %-10.4f %-10.4f %-10.4f
 void printtimes(){
 	printf("TIMES ARE\n");
@@ -183,7 +615,7 @@ void printtimes(){
 int main2(){
 	
 	ll P = 1000, m = 1024;
-	ll ms = m/P;
+	ll ms = SEG_SIZE;
 	ll * ans = malloc(3*sizeof(ll));
 	Stage1(P, m, ms, ans);
 	printtimes();
@@ -1,4 +1,18 @@
 #include"macros.h"
 extern execAllReduce algo[NUM_ALGOS];
-double Stage1(ll P, ll m, ll ms, ll * ans);
-void my_init(char path[]);
\ No newline at end of file
+double Stage1(ll P, ll m, ll ms, ll * ans);		//m and ms are counted in 8-byte (double) elements: scale by type size / 8 for other datatypes
+double algo_time(int a, ll P, ll m, ll ms);		//one algorithm over all P ranks, no grid
+double Stage1_ranked(ll P, ll m, ll ms, stage1_entry *table);		//table: NUM_ALGOS*NUM_ALGOS entries, distinct effective plans fastest first
+unsigned long long calibration_fingerprint(ll ms);		//changes whenever Stage1 could answer differently for the same (P, m)
+void my_init(char path[]);									//my_init_algos + load_params
+void my_init_algos();
+int load_params(char path[]);
+int save_params(char path[]);
+void set_params(double abg[3][NUM_ALGOS]);				//e.g. the output of calibrate()
+void get_params(double abg[3][NUM_ALGOS]);
+double Stage1_root(int root, MPI_Comm comm, ll P, ll m, ll ms, ll * ans);	//Stage1_cached on root only, decision broadcast to comm
+void my_init_intra(char path[]);
+double Stage1_topo(ll nodes, ll ppn, ll m, ll ms, int uniform, ll * ans);	//ans[0]: intra-node algo (or INTRA_SHM), ans[1]: inter-node algo; uniform as in topo_comms
+double scheme_time(int scheme, int row, int col, ll P, ll Pc, ll m, ll ms);	//one 2D plan (SCHEME_* in macros.h), 1e10 if it cannot run
+double Stage1_2d(ll P, ll m, ll ms, ll * ans, int *scheme);		//Stage1 over every SCHEME_*: ans as in Stage1
+double Stage1_kd(ll P, ll m, ll ms, int kmax, ll *dims, ll *algos, int *ndims);	//up to kmax grid dimensions, see grid_allreduce.h
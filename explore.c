@@ -0,0 +1,74 @@
+#include "explore.h"
+#include "est_time.h"
+#include "stage1_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+void explore_init(explore_ctx *ex, MPI_Comm comm, ll ms, int k) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    memset(ex, 0, sizeof(*ex));
+    ex->comm = comm;
+    ex->P = size;
+    ex->ms = ms;
+    ex->k = (k < 1) ? 1 : (k > EXPLORE_TOP_K ? EXPLORE_TOP_K : k);
+    grid_cache_init(&ex->grids, comm);
+}
+
+// Shortlists the class's candidates on rank 0 and hands them to everyone
+static void shortlist(explore_ctx *ex, explore_class *c, ll bucket) {
+    int rank;
+    MPI_Comm_rank(ex->comm, &rank);
+    if (rank == 0) {
+        stage1_entry table[NUM_ALGOS * NUM_ALGOS];
+        Stage1_ranked(ex->P, stage1_bucket_mid(bucket), ex->ms, table);
+        c->ncand = 0;
+        for (int i = 0; i < ex->k && table[i].time < 1e10; i++) c->cand[c->ncand++] = table[i];
+    }
+    MPI_Bcast(&c->ncand, 1, MPI_INT, 0, ex->comm);
+    MPI_Bcast(c->cand, c->ncand * sizeof(stage1_entry), MPI_BYTE, 0, ex->comm);
+
+    for (int i = 0; i < c->ncand; i++) c->measured[i] = 1e30;
+    c->calls = 0;
+    c->winner = 0;
+    // nothing to compare when the model leaves a single candidate
+    c->state = (c->ncand > 1) ? EXPLORE_RUNNING : EXPLORE_LOCKED;
+}
+
+void explore_allreduce(explore_ctx *ex, void *sendbuf, void *recvbuf, ll count,
+                       MPI_Datatype datatype, MPI_Op op) {
+    int type_size;
+    MPI_Type_size(datatype, &type_size);
+    ll bucket = stage1_bucket((count * type_size + 7) / 8);
+    explore_class *c = &ex->cls[bucket];
+
+    if (c->state == EXPLORE_UNSEEN) shortlist(ex, c, bucket);
+
+    if (c->state == EXPLORE_LOCKED) {
+        stage1_entry *w = &c->cand[c->winner];
+        ll algos[2] = {w->row, w->col};
+        grid_allreduce(sendbuf, recvbuf, count, datatype, op, grid_cache_get(&ex->grids, w->Pc), algos);
+        return;
+    }
+
+    int i = c->calls % c->ncand;			// candidates take turns, so drift hits them all alike
+    stage1_entry *e = &c->cand[i];
+    ll algos[2] = {e->row, e->col};
+    grid_comms *g = grid_cache_get(&ex->grids, e->Pc);
+
+    double t0 = MPI_Wtime();
+    grid_allreduce(sendbuf, recvbuf, count, datatype, op, g, algos);
+    double elapsed = MPI_Wtime() - t0, slowest;
+    MPI_Allreduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX, ex->comm);
+    if (slowest < c->measured[i]) c->measured[i] = slowest;
+
+    if (++c->calls == c->ncand * EXPLORE_REPS) {
+        for (int j = 1; j < c->ncand; j++)
+            if (c->measured[j] < c->measured[c->winner]) c->winner = j;
+        c->state = EXPLORE_LOCKED;
+    }
+}
+
+void explore_free(explore_ctx *ex) {
+    grid_cache_free(&ex->grids);
+}
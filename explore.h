@@ -0,0 +1,56 @@
+#ifndef EXPLORE_H
+#define EXPLORE_H
+
+#include "macros.h"
+#include "grid_allreduce.h"
+
+/**
+ * @brief Explore-then-exploit SUARA: the model shortlists, measurements decide.
+ *
+ * The first call of each size class (stage1_bucket of the message size)
+ * takes the top k (algorow, algocol, Pc) entries of Stage1_ranked, computed
+ * on rank 0 and broadcast. The next k * EXPLORE_REPS real allreduces of that
+ * class run those candidates in turn; each call's elapsed time is
+ * max-reduced over comm so all ranks see the same numbers. The candidate
+ * with the lowest measured time is then locked in for the class and later
+ * calls run it without any extra communication.
+ *
+ * Usage (parameters loaded on rank 0):
+ *     explore_ctx ex;
+ *     explore_init(&ex, MPI_COMM_WORLD, SEG_SIZE, EXPLORE_TOP_K);
+ *     for (...) explore_allreduce(&ex, sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM);
+ *     explore_free(&ex);
+ */
+
+#define EXPLORE_TOP_K 3
+#define EXPLORE_REPS 2			// timed calls per candidate; the fastest counts
+#define EXPLORE_CLASSES 64		// one per possible log2 bucket
+
+typedef struct {
+    int state;                          // EXPLORE_UNSEEN, EXPLORE_RUNNING or EXPLORE_LOCKED
+    int ncand;
+    stage1_entry cand[EXPLORE_TOP_K];
+    double measured[EXPLORE_TOP_K];     // fastest slowest-rank time so far
+    int calls;                          // exploration calls made
+    int winner;
+} explore_class;
+
+#define EXPLORE_UNSEEN 0
+#define EXPLORE_RUNNING 1
+#define EXPLORE_LOCKED 2
+
+typedef struct {
+    MPI_Comm comm;
+    ll P, ms;
+    int k;
+    explore_class cls[EXPLORE_CLASSES];
+
+    grid_cache grids;                   // communicators of every Pc tried so far
+} explore_ctx;
+
+void explore_init(explore_ctx *ex, MPI_Comm comm, ll ms, int k);
+void explore_allreduce(explore_ctx *ex, void *sendbuf, void *recvbuf, ll count,
+                       MPI_Datatype datatype, MPI_Op op);
+void explore_free(explore_ctx *ex);
+
+#endif
@@ -0,0 +1,105 @@
+#include "fusion.h"
+#include "est_time.h"
+#include "stage1_cache.h"
+#include "reduce_ops.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FUSION_MAX_M (1LL << 30)
+
+// Measured against the best plan at every size rather than the split of one formula into
+// alpha and beta terms: a segmented ring, for instance, pays alpha per segment, which fusion
+// cannot save
+ll fusion_crossover(ll P, ll ms) {
+    ll ans[3];
+    double fixed = Stage1(P, 1, ms, ans);
+    for (ll m = 2; m < FUSION_MAX_M; m *= 2) {
+        if (Stage1(P, m, ms, ans) >= 2 * fixed) return m;
+    }
+    return FUSION_MAX_M;
+}
+
+void fusion_init(fusion_ctx *fz, MPI_Comm comm, MPI_Datatype datatype, MPI_Op op, ll threshold, double timeout) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    memset(fz, 0, sizeof(*fz));
+    fz->comm = comm;
+    fz->datatype = datatype;
+    fz->op = op;
+    MPI_Type_size(datatype, &fz->type_size);
+    fz->P = size;
+    fz->ms = SEG_SIZE;
+    fz->timeout = timeout;
+
+    if (threshold <= 0) {
+        // the model works in 8-byte elements
+        if (rank == 0) threshold = fusion_crossover(fz->P, fz->ms) * 8 / fz->type_size;
+        MPI_Bcast(&threshold, 1, MPI_LONG_LONG, 0, comm);
+    }
+    fz->threshold = threshold > 0 ? threshold : 1;
+
+    fz->bucket = (char *) reduce_alloc(fz->threshold * fz->type_size);
+    fz->max_entries = 64;
+    fz->entries = (fusion_entry *) malloc(fz->max_entries * sizeof(fusion_entry));
+    grid_cache_init(&fz->grids, comm);
+}
+
+// Runs the SUARA plan for count elements; decisions are taken once per log2 size bucket
+static void run(fusion_ctx *fz, const void *sendbuf, void *recvbuf, ll count) {
+    ll m = (count * fz->type_size + 7) / 8;
+    ll b = stage1_bucket(m);
+    if (!fz->have[b]) {
+        Stage1_root(0, fz->comm, fz->P, m, fz->ms, fz->decision[b]);
+        fz->have[b] = 1;
+    }
+    ll algos[2] = {fz->decision[b][0], fz->decision[b][1]};
+    grid_allreduce((void *)sendbuf, recvbuf, count, fz->datatype, fz->op,
+                   grid_cache_get(&fz->grids, fz->decision[b][2]), algos);
+}
+
+void fusion_flush(fusion_ctx *fz) {
+    if (fz->nentries == 0) return;
+    run(fz, MPI_IN_PLACE, fz->bucket, fz->used);
+    for (int i = 0; i < fz->nentries; i++) {
+        fusion_entry *e = &fz->entries[i];
+        memcpy(e->recvbuf, fz->bucket + e->offset * fz->type_size, e->count * fz->type_size);
+    }
+    fz->nentries = 0;
+    fz->used = 0;
+    fz->flushes++;
+}
+
+void fusion_add(fusion_ctx *fz, const void *sendbuf, void *recvbuf, ll count) {
+    // too large to gain anything from fusion: run it on its own, after what is already queued
+    if (count >= fz->threshold) {
+        fusion_flush(fz);
+        run(fz, sendbuf, recvbuf, count);
+        return;
+    }
+    if (fz->used + count > fz->threshold) fusion_flush(fz);
+
+    if (fz->nentries == fz->max_entries) {
+        fz->max_entries *= 2;
+        fz->entries = (fusion_entry *) realloc(fz->entries, fz->max_entries * sizeof(fusion_entry));
+    }
+    if (fz->nentries == 0) fz->oldest = MPI_Wtime();
+    fusion_entry *e = &fz->entries[fz->nentries++];
+    e->recvbuf = recvbuf;
+    e->offset = fz->used;
+    e->count = count;
+    memcpy(fz->bucket + fz->used * fz->type_size, sendbuf, count * fz->type_size);
+    fz->used += count;
+}
+
+void fusion_poll(fusion_ctx *fz) {
+    int expired = (fz->nentries > 0 && MPI_Wtime() - fz->oldest > fz->timeout), any;
+    MPI_Allreduce(&expired, &any, 1, MPI_INT, MPI_MAX, fz->comm);
+    if (any) fusion_flush(fz);
+}
+
+void fusion_free(fusion_ctx *fz) {
+    grid_cache_free(&fz->grids);
+    free(fz->bucket);
+    free(fz->entries);
+}
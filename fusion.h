@@ -0,0 +1,71 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include "macros.h"
+#include "grid_allreduce.h"
+
+/**
+ * @brief Tensor fusion: many small allreduces become one SUARA allreduce.
+ *
+ * fusion_add() copies a tensor into the bucket and remembers where its
+ * result goes; fusion_flush() runs one 2D SUARA allreduce on the whole
+ * bucket and copies every slice back to its recvbuf. Results are only valid
+ * after the flush that covers them.
+ *
+ * A bucket is flushed automatically once adding a tensor would overflow
+ * the threshold. By default the threshold is the cost model's crossover
+ * (fusion_crossover): the smallest message Stage1 predicts to take at least
+ * twice as long as a 1-element one, i.e. where the per-call latency stops
+ * dominating. Fusing beyond it saves little and only delays results.
+ *
+ * Every flush is a collective, so flushes are decided from what all ranks
+ * agree on: the sequence of fusion_add sizes, or fusion_poll(), which
+ * max-reduces "my oldest tensor has waited longer than timeout" and flushes
+ * everywhere if any rank says so.
+ *
+ * Usage (parameters loaded on rank 0):
+ *     fusion_ctx fz;
+ *     fusion_init(&fz, MPI_COMM_WORLD, MPI_FLOAT, MPI_SUM, 0, 0.005);
+ *     for (each tensor) fusion_add(&fz, grad_i, out_i, n_i);
+ *     fusion_flush(&fz);
+ *     fusion_free(&fz);
+ */
+
+typedef struct {
+    void *recvbuf;
+    ll offset, count;           // slice of the bucket, in elements
+} fusion_entry;
+
+typedef struct {
+    MPI_Comm comm;
+    MPI_Datatype datatype;
+    MPI_Op op;
+    int type_size;
+    ll P, ms;
+
+    ll threshold;               // bucket capacity, in elements
+    double timeout;             // seconds, checked by fusion_poll
+    char *bucket;               // packed inputs, reduced in place
+    ll used;
+    int nentries, max_entries;
+    fusion_entry *entries;
+    double oldest;              // MPI_Wtime of the first tensor in the bucket
+
+    int have[64];               // per log2 size bucket: decision taken
+    ll decision[64][3];         // (algorow, algocol, Pc)
+    grid_cache grids;
+
+    ll flushes;
+} fusion_ctx;
+
+// threshold: elements per bucket, 0 = fusion_crossover
+void fusion_init(fusion_ctx *fz, MPI_Comm comm, MPI_Datatype datatype, MPI_Op op, ll threshold, double timeout);
+void fusion_add(fusion_ctx *fz, const void *sendbuf, void *recvbuf, ll count);
+void fusion_poll(fusion_ctx *fz);
+void fusion_flush(fusion_ctx *fz);
+void fusion_free(fusion_ctx *fz);
+
+// Smallest m (8-byte elements, power of two) with Stage1(P, m) >= 2 * Stage1(P, 1)
+ll fusion_crossover(ll P, ll ms);
+
+#endif
@@ -5,14 +5,26 @@
 double times41[NUM_ALGOS][NUM_ALGOS];
 int factorsP[MAX_FACTORS+1];						//factorsP[i] stores the list of factors for a given P. For every new P, we override the factorsP arr
 int NUM_FACTORS = 0;
+ll SEG_SIZE = DEFAULT_SEG_SIZE;
 
 
 void find_and_store_factors(int P){
-	for(int i=1; i<ceil(sqrt(P)); i++){
+	NUM_FACTORS = 0;						//factorsP only ever holds the factors of the latest P
+	for(int i=1; (ll)i*i<=P; i++){
 		if(P%i == 0){
 			factorsP[NUM_FACTORS++] = i;
-			factorsP[NUM_FACTORS++] = P/i;
+			if(i != P/i)
+				factorsP[NUM_FACTORS++] = P/i;
 		}
 	}
 }
 
+//The first count % size chunks get one extra element, so chunk sizes differ by at most 1
+void chunk_offsets(ll count, int size, ll *offsets){
+	ll base = count / size;
+	ll extra = count % size;
+	offsets[0] = 0;
+	for(int i=0; i<size; i++){
+		offsets[i+1] = offsets[i] + base + (i < extra ? 1 : 0);
+	}
+}
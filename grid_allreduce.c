@@ -0,0 +1,181 @@
+#include "grid_allreduce.h"
+#include "allreduce_plan.h"
+#include "reduce_ops.h"
+#include <string.h>
+#include <stdlib.h>
+
+// SCHEME_DUAL's plans, plans[h][d] for half h in its d-th phase (half 0 row then column, half 1
+// column then row), kept for the last (grid, count, datatype, op, algos) they were built for.
+// Building them costs four allreduce_plan_create (step lists, scratch, persistent requests),
+// which repeated calls with the same arguments skip; grid_comms_free drops them.
+#define DUAL_TAG 900						// below suara_iallreduce's tags; half h uses DUAL_TAG + h
+
+static struct {
+    int valid;
+    MPI_Comm comms[2];
+    ll count;
+    MPI_Datatype datatype;
+    MPI_Op op;
+    ll algos[2];
+    allreduce_plan *plans[2][2];
+} dual_cache;
+
+static void dual_cache_clear(void) {
+    if (!dual_cache.valid) return;
+    for (int h = 0; h < 2; h++)
+        for (int d = 0; d < 2; d++) allreduce_plan_free(dual_cache.plans[h][d]);
+    dual_cache.valid = 0;
+}
+
+static void dual_cache_get(grid_comms *g, ll count, MPI_Datatype datatype, MPI_Op op, const ll *algos) {
+    if (dual_cache.valid && dual_cache.comms[0] == g->comms[0] && dual_cache.comms[1] == g->comms[1] &&
+        dual_cache.count == count && dual_cache.datatype == datatype && dual_cache.op == op &&
+        dual_cache.algos[0] == algos[0] && dual_cache.algos[1] == algos[1]) return;
+
+    dual_cache_clear();
+    ll half = (count + 1) / 2;
+    for (int h = 0; h < 2; h++) {
+        for (int d = 0; d < 2; d++) {
+            int dim = h ? 1 - d : d;
+            dual_cache.plans[h][d] = NULL;
+            if (h == 1 && count - half == 0) continue;
+            dual_cache.plans[h][d] = allreduce_plan_create(g->comms[dim], h ? count - half : half, datatype, op, algos[dim]);
+            dual_cache.plans[h][d]->tag = DUAL_TAG + h;
+        }
+    }
+    dual_cache.comms[0] = g->comms[0];
+    dual_cache.comms[1] = g->comms[1];
+    dual_cache.count = count;
+    dual_cache.datatype = datatype;
+    dual_cache.op = op;
+    dual_cache.algos[0] = algos[0];
+    dual_cache.algos[1] = algos[1];
+    dual_cache.valid = 1;
+}
+
+void grid_comms_create(MPI_Comm comm, int ndims, const ll *dims, grid_comms *g) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    g->ndims = ndims;
+
+    ll stride = 1;
+    for (int d = 0; d < ndims; d++) {
+        g->dims[d] = dims[d];
+        ll coord = (rank / stride) % dims[d];
+        // Same color for every rank that agrees on all the other coordinates
+        int color = (int)(rank - coord * stride);
+        MPI_Comm_split(comm, color, rank, &g->comms[d]);
+        stride *= dims[d];
+    }
+}
+
+void grid_comms_free(grid_comms *g) {
+    if (dual_cache.valid && g->ndims == 2 && dual_cache.comms[0] == g->comms[0] && dual_cache.comms[1] == g->comms[1])
+        dual_cache_clear();
+    for (int d = 0; d < g->ndims; d++) MPI_Comm_free(&g->comms[d]);
+    g->ndims = 0;
+}
+
+void grid_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                    grid_comms *g, const ll *algos) {
+    grid_allreduce_timed(sendbuf, recvbuf, count, datatype, op, g, algos, NULL);
+}
+
+void grid_allreduce_timed(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                          grid_comms *g, const ll *algos, double *dim_times) {
+    if (g->ndims == 0) {
+        int type_size;
+        MPI_Type_size(datatype, &type_size);
+        if (!IS_IN_PLACE(sendbuf, recvbuf)) memcpy(recvbuf, sendbuf, count * type_size);
+        return;
+    }
+
+    // Each later dimension reduces the previous dimension's result where it lies
+    for (int d = 0; d < g->ndims; d++) {
+        double t0 = MPI_Wtime();
+        algo[algos[d]](d == 0 ? sendbuf : MPI_IN_PLACE, recvbuf, count, datatype, op, g->comms[d]);
+        if (dim_times) dim_times[d] = MPI_Wtime() - t0;
+    }
+}
+
+// SCHEME_DUAL: both halves' step lists progressed side by side; a half starts its second
+// phase in place as soon as its first completes
+static void dual_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                           grid_comms *g, const ll *algos) {
+    int type_size;
+    MPI_Type_size(datatype, &type_size);
+    int in_place = IS_IN_PLACE(sendbuf, recvbuf);
+    ll half = (count + 1) / 2;
+    dual_cache_get(g, count, datatype, op, algos);
+
+    char *buf[2] = {(char *)recvbuf, (char *)recvbuf + half * type_size};
+    int phase[2] = {0, 2};
+    allreduce_plan_start(dual_cache.plans[0][0], in_place ? MPI_IN_PLACE : sendbuf, buf[0]);
+    if (dual_cache.plans[1][0] != NULL) {
+        allreduce_plan_start(dual_cache.plans[1][0], in_place ? MPI_IN_PLACE : (char *)sendbuf + half * type_size, buf[1]);
+        phase[1] = 0;
+    }
+    while (phase[0] < 2 || phase[1] < 2) {
+        for (int h = 0; h < 2; h++) {
+            if (phase[h] == 2 || !allreduce_plan_test(dual_cache.plans[h][phase[h]])) continue;
+            if (++phase[h] < 2) allreduce_plan_start(dual_cache.plans[h][phase[h]], MPI_IN_PLACE, buf[h]);
+        }
+    }
+}
+
+void grid_allreduce_2d(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                       grid_comms *g, const ll *algos, int scheme) {
+    if (scheme == SCHEME_DUAL && g->ndims == 2) {
+        dual_allreduce(sendbuf, recvbuf, count, datatype, op, g, algos);
+        return;
+    }
+
+    algo_entry *row = &algo_registry[algos[0]];
+    // Stage1_2d never pairs SCHEME_RS with a row algorithm that has no reduce-scatter
+    if (scheme != SCHEME_RS || g->ndims != 2 || row->reduce_scatter == NULL) {
+        grid_allreduce(sendbuf, recvbuf, count, datatype, op, g, algos);
+        return;
+    }
+
+    int type_size;
+    MPI_Type_size(datatype, &type_size);
+    if (!IS_IN_PLACE(sendbuf, recvbuf)) memcpy(recvbuf, sendbuf, count * type_size);
+
+    ll shard_off, shard_len;
+    row->reduce_scatter(recvbuf, count, datatype, op, g->comms[0], &shard_off, &shard_len);
+    // Every rank of a column sits at the same row position, so they all hold the same shard
+    if (shard_len > 0) {
+        algo[algos[1]](MPI_IN_PLACE, (char *)recvbuf + shard_off * type_size, shard_len, datatype, op, g->comms[1]);
+    }
+    row->allgather(recvbuf, count, datatype, g->comms[0]);
+}
+
+void grid_cache_init(grid_cache *c, MPI_Comm comm) {
+    c->comm = comm;
+    c->n = 0;
+    c->pc = NULL;
+    c->grids = NULL;
+}
+
+grid_comms *grid_cache_get(grid_cache *c, ll Pc) {
+    for (int i = 0; i < c->n; i++)
+        if (c->pc[i] == Pc) return &c->grids[i];
+
+    int size;
+    MPI_Comm_size(c->comm, &size);
+    c->pc = (ll *) realloc(c->pc, (c->n + 1) * sizeof(ll));
+    c->grids = (grid_comms *) realloc(c->grids, (c->n + 1) * sizeof(grid_comms));
+    ll dims[2] = {Pc, size / Pc};
+    grid_comms_create(c->comm, 2, dims, &c->grids[c->n]);
+    c->pc[c->n] = Pc;
+    return &c->grids[c->n++];
+}
+
+void grid_cache_free(grid_cache *c) {
+    for (int i = 0; i < c->n; i++) grid_comms_free(&c->grids[i]);
+    free(c->grids);
+    free(c->pc);
+    c->n = 0;
+    c->pc = NULL;
+    c->grids = NULL;
+}
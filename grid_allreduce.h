@@ -0,0 +1,68 @@
+#ifndef GRID_ALLREDUCE_H
+#define GRID_ALLREDUCE_H
+
+#include "macros.h"
+
+/**
+ * @brief k-dimensional SUARA grid: P = dims[0] x dims[1] x ... x dims[ndims-1].
+ *
+ * Rank r has mixed-radix coordinates with dims[0] varying fastest, so the
+ * 2D case (dims = {Pc, P/Pc}) matches suara2's row_id = rank / Pc,
+ * col_id = rank % Pc. comms[d] holds the dims[d] ranks that differ only in
+ * coordinate d; grid_allreduce runs algos[d] over comms[d] for d = 0, 1, ...
+ *
+ * Usage:
+ *     ll dims[MAX_GRID_DIMS], algos[MAX_GRID_DIMS]; int ndims;
+ *     Stage1_kd(P, m, ms, 3, dims, algos, &ndims);
+ *     grid_comms g;
+ *     grid_comms_create(MPI_COMM_WORLD, ndims, dims, &g);
+ *     grid_allreduce(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, &g, algos);
+ *     grid_comms_free(&g);
+ */
+
+typedef struct {
+    int ndims;
+    ll dims[MAX_GRID_DIMS];
+    MPI_Comm comms[MAX_GRID_DIMS];
+} grid_comms;
+
+void grid_comms_create(MPI_Comm comm, int ndims, const ll *dims, grid_comms *g);
+void grid_comms_free(grid_comms *g);
+
+void grid_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                    grid_comms *g, const ll *algos);
+// Same, also storing this rank's time spent in each dimension in dim_times[0 .. ndims)
+void grid_allreduce_timed(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                          grid_comms *g, const ll *algos, double *dim_times);
+
+/**
+ * 2D grid (ndims == 2) with the SCHEME_* Stage1_2d picked. SCHEME_RS
+ * reduce-scatters along rows with algos[0] (which must have a registry
+ * reduce_scatter), allreduces only the shard a row position owns along its
+ * column with algos[1], then allgathers along rows: the column phase moves
+ * about count / Pc elements instead of count. SCHEME_DUAL sends the first
+ * half row then column and the second half column then row, concurrently
+ * (the halves' allreduce_plan step lists progressed side by side), so row
+ * and column links are both busy in both phases. Its four plans are built
+ * on the first call and reused while (g, count, datatype, op, algos) stay
+ * the same; grid_comms_free(g) releases them.
+ */
+void grid_allreduce_2d(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                       grid_comms *g, const ll *algos, int scheme);
+
+/**
+ * 2D grids (dims {Pc, P/Pc}) built on first use and kept, for callers that
+ * switch between Pc values: the communicators are split once per Pc.
+ */
+typedef struct {
+    MPI_Comm comm;
+    int n;
+    ll *pc;
+    grid_comms *grids;
+} grid_cache;
+
+void grid_cache_init(grid_cache *c, MPI_Comm comm);
+grid_comms *grid_cache_get(grid_cache *c, ll Pc);		//collective over comm the first time Pc is asked for
+void grid_cache_free(grid_cache *c);
+
+#endif
@@ -1,41 +1,84 @@
 #include "linear_allreduce.h"
+#include "reduce_ops.h"
 #include <string.h>
 #include <stdlib.h>
 
-void linear_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Comm comm) {
-    int rank, size;
+/**
+ * @brief Pipelined chain allreduce: reduce down the chain towards rank 0, then broadcast back.
+ *
+ * The buffer is cut into SEG_SIZE element segments. Rank i forwards segment
+ * k to rank i-1 as soon as rank i+1's segment k has been combined into it,
+ * so every link of the chain carries a different segment at once. Rank 0
+ * starts the broadcast as soon as its last segment is reduced, and every
+ * other rank posts its broadcast receives once its partial sums have left,
+ * so there is no barrier between the phases. This is the schedule
+ * hockneytime_lin() models with ms = SEG_SIZE.
+ */
+void linear_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm) {
+    int rank, size, type_size;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
-    
-    double *send_buf = (double*)sendbuf;
-    double *recv_buf = (double*)recvbuf;
-    const int ROOT = 0;
-    
-    double *temp_buf = (double*)malloc(count * sizeof(double));
-    memcpy(recv_buf, send_buf, count * sizeof(double));
-
-    // PHASE 1: REDUCE TO ROOT
-    for (int i = size - 1; i > ROOT; i--) {
-        if (rank == i) {
-            MPI_Send(recv_buf, count, MPI_DOUBLE, rank - 1, 0, comm); 
-        } else if (rank == i - 1) {
-            MPI_Recv(temp_buf, count, MPI_DOUBLE, rank + 1, 0, comm, MPI_STATUS_IGNORE);
-            for (ll j = 0; j < count; j++) {
-                recv_buf[j] += temp_buf[j];
-            }
+    MPI_Type_size(datatype, &type_size);
+    reduce_fn reduce = get_reduce_fn_or_abort(datatype, op, comm);
+
+    char *send_buf = (char*)sendbuf;
+    char *recv_buf = (char*)recvbuf;
+
+    if (!IS_IN_PLACE(send_buf, recv_buf)) memcpy(recv_buf, send_buf, count * type_size);
+    if (size == 1 || count == 0) return;
+
+    int prev = rank - 1;                        // towards the root, -1 at rank 0
+    int next = (rank < size - 1) ? rank + 1 : -1;
+    ll seg_size = (SEG_SIZE > 0 && SEG_SIZE < count) ? SEG_SIZE : count;
+    int nseg = (int)((count + seg_size - 1) / seg_size);
+
+    // Two landing slots, so segment k+1 can arrive while segment k is combined
+    char *slots = (char*)reduce_alloc(2 * seg_size * type_size);
+    MPI_Request recv_req[2];
+    MPI_Request *up_req = (MPI_Request *) malloc(sizeof(MPI_Request) * nseg);
+    MPI_Request *down_req = (MPI_Request *) malloc(sizeof(MPI_Request) * 2 * nseg);
+    for (int k = 0; k < nseg; k++) up_req[k] = MPI_REQUEST_NULL;
+    for (int k = 0; k < 2 * nseg; k++) down_req[k] = MPI_REQUEST_NULL;
+
+    // PHASE 1: REDUCE TOWARDS ROOT, one segment per link at a time
+    for (int k = 0; k <= nseg; k++) {
+        if (k < nseg && next >= 0) {
+            ll len = (k == nseg - 1) ? count - k * seg_size : seg_size;
+            MPI_Irecv(slots + (k & 1) * seg_size * type_size, len, datatype, next, 0, comm, &recv_req[k & 1]);
+        }
+        if (k == 0) continue;
+
+        int s = k - 1;
+        ll off = s * seg_size;
+        ll len = (s == nseg - 1) ? count - off : seg_size;
+        if (next >= 0) {
+            MPI_Wait(&recv_req[s & 1], MPI_STATUS_IGNORE);
+            reduce_apply(reduce, recv_buf + off * type_size, slots + (s & 1) * seg_size * type_size, len, type_size);
+        }
+        if (prev >= 0) {
+            MPI_Isend(recv_buf + off * type_size, len, datatype, prev, 0, comm, &up_req[s]);
+        }
+    }
+
+    // PHASE 2: BROADCAST FROM ROOT, segment k lands in place once our partial sum of it has left
+    MPI_Request *from_prev = down_req + nseg;
+    if (prev >= 0) {
+        for (int k = 0; k < nseg; k++) {
+            ll len = (k == nseg - 1) ? count - k * seg_size : seg_size;
+            MPI_Wait(&up_req[k], MPI_STATUS_IGNORE);
+            MPI_Irecv(recv_buf + k * seg_size * type_size, len, datatype, prev, 1, comm, &from_prev[k]);
         }
     }
-    
-    MPI_Barrier(comm); 
-
-    // PHASE 2: BROADCAST FROM ROOT
-    for (int i = 0; i < size - 1; i++) {
-        if (rank == i) {
-            MPI_Send(recv_buf, count, MPI_DOUBLE, rank + 1, 1, comm);
-        } else if (rank == i + 1) {
-            MPI_Recv(recv_buf, count, MPI_DOUBLE, rank - 1, 1, comm, MPI_STATUS_IGNORE);
+    for (int k = 0; k < nseg; k++) {
+        ll len = (k == nseg - 1) ? count - k * seg_size : seg_size;
+        MPI_Wait(&from_prev[k], MPI_STATUS_IGNORE);
+        if (next >= 0) {
+            MPI_Isend(recv_buf + k * seg_size * type_size, len, datatype, next, 1, comm, &down_req[k]);
         }
     }
+    MPI_Waitall(nseg, down_req, MPI_STATUSES_IGNORE);
 
-    free(temp_buf);
-}
\ No newline at end of file
+    free(down_req);
+    free(up_req);
+    free(slots);
+}
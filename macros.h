@@ -8,27 +8,69 @@
 #define RING_ALL_REDUCE 2
 #define RING_SEG_ALL_REDUCE 3
 #define RECURSIVE_DOUBLING_ALL_REDUCE 4
+#define TREE_ALL_REDUCE 5
+#define DOUBLE_TREE_ALL_REDUCE 6
 
 
-#define NUM_ALGOS 5
+#define NUM_ALGOS 7
 #define MAX_FACTORS (int)1e5
 // int MAX_FACTORS = (int)1e5;
+#define MAX_GRID_DIMS 8							//most dimensions Stage1_kd / grid_allreduce will split P into
+#define DEFAULT_SEG_SIZE 4096						//default segment size (in elements) for RING_SEG_ALL_REDUCE and the tree algorithms
 
 typedef long long ll;
 
-typedef double (*getTimeandPc)(ll, ll, ll, double[][NUM_ALGOS], ll*);         //defines a type called getTimeandPc which is a function pointer to a function that takes in (P, m, ms, alpha_beta_gamma, optimal_Pc) & returns a double containing time_taken to apply allReduce algo i on rows, and j on columns
-//takes in P, m, alpha, beta, gamma
-//pointer to Pc to return it
+typedef double (*getTime)(ll, ll, ll, double, double, double);	//single-algorithm Hockney model: (P, m, ms, alpha, beta, gamma) -> time
 
-typedef void (*execAllReduce)(void *, void *, ll, MPI_Comm);
-//int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+typedef void (*execAllReduce)(void *, void *, ll, MPI_Datatype, MPI_Op, MPI_Comm);
+//same argument order as int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+//supported (datatype, op) pairs are listed in reduce_ops.h
+//sendbuf may be MPI_IN_PLACE (or recvbuf itself): the input is then read from recvbuf, with no copy
+
+#define IS_IN_PLACE(sendbuf, recvbuf) ((void *)(sendbuf) == MPI_IN_PLACE || (void *)(sendbuf) == (void *)(recvbuf))
+
+typedef void (*execReduceScatter)(void *, ll, MPI_Datatype, MPI_Op, MPI_Comm, ll *, ll *);
+//(recvbuf, count, datatype, op, comm, &shard_off, &shard_len): in place on recvbuf; on return
+//recvbuf[shard_off, shard_off + shard_len) is fully reduced. The shard depends only on (rank, size, count).
+typedef void (*execAllgather)(void *, ll, MPI_Datatype, MPI_Comm);
+//(recvbuf, count, datatype, comm): the matching allgather, rebuilds all of recvbuf from every rank's shard
+
+//One entry of the algorithm registry (est_time.c). Stage1 and its variants only look at the registry,
+//so adding an algorithm means adding a macro above, bumping NUM_ALGOS and adding one entry.
+typedef struct {
+	const char *name;					//row label in the data_store csvs
+	getTime cost;						//Hockney model over one grid dimension
+	execAllReduce exec;
+	int pow2_only;						//only valid over a power-of-two number of ranks
+	execReduceScatter reduce_scatter;	//exec's reduce-scatter phase on its own, NULL if it has none
+	execAllgather allgather;			//exec's allgather phase; reduce_scatter then allgather == exec
+	int rs_pow2_core;					//reduce_scatter shards over the largest power of two <= P ranks, not all P
+	int plan_exact;						//allreduce_plan's step list is exec's schedule, so cost also prices the nonblocking path
+} algo_entry;
+
+//2D schemes Stage1_2d chooses between (grid_allreduce_2d)
+#define SCHEME_FULL 0						//full allreduce along rows, then along columns
+#define SCHEME_RS 1							//row reduce-scatter, column allreduce of the shard, row allgather
+#define SCHEME_DUAL 2						//half the buffer row then column, the other half column then row, at once
+#define NUM_SCHEMES 3
+
+//One row of Stage1's ranked table: algorithm row over Pc ranks, col over P/Pc ranks
+typedef struct {
+	int row, col;
+	ll Pc;
+	double time;
+} stage1_entry;
 
 extern double times41[NUM_ALGOS][NUM_ALGOS]; 
 
 
 void find_and_store_factors(int P);
+void chunk_offsets(ll count, int size, ll *offsets);		//splits count elements into size contiguous chunks: chunk i is [offsets[i], offsets[i+1])
 extern int NUM_FACTORS;
 extern int factorsP[MAX_FACTORS+1];
 extern execAllReduce algo[NUM_ALGOS];		
+extern algo_entry algo_registry[NUM_ALGOS];			//algo_registry[i] describes algorithm i; algo[i] == algo_registry[i].exec
+int algo_allowed(int i, ll P);						//1 if algorithm i may run over P ranks
+extern ll SEG_SIZE;									//segment size (in elements) used by ring_seg_allreduce; Stage1 should be called with ms = SEG_SIZE
 
 
@@ -0,0 +1,214 @@
+"""
+Runs a (platform, P, algorithm, m) sweep of the benchmark driver (../bench)
+with several simulations at once, and merges the results into one CSV.
+
+Every point of the matrix is one independent `smpirun ... ./bench` run
+measuring a single (algorithm, m) pair. SimGrid simulates all ranks in one
+process, so a point costs one core; with --launcher mpirun it costs P cores.
+Points are started as long as the running ones fit in --cores.
+
+Each finished point is kept in --cache as <key>.csv (the bench output) and
+<key>.json (provenance). The key hashes everything that can change the
+result: the bench binary, the platform and parameter files, P, m, the
+algorithm, warmup/iters/seg and the launcher. A point whose key is already
+cached is not run again, so an interrupted sweep resumes where it stopped
+and only points affected by a rebuild or an edited platform are re-run.
+
+Usage (from the repository root, after `make bench`):
+    python3 network_configuration_estimation/run_sweep.py \\
+        --procs 4,8,16,32,64 --sizes geom:1:1048576:4 --algos lin,rab,rnos,rs,rd,tree,dbt,suara \\
+        --platforms network_configuration_estimation/platform.xml --cores 64 --out sweep.csv
+"""
+
+import argparse
+import csv
+import hashlib
+import json
+import os
+import shlex
+import socket
+import subprocess
+import sys
+import time
+from datetime import datetime, timezone
+from itertools import product
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def expand_sizes(spec):
+    """Same range syntax as bench --sizes: geom:min:max[:factor] or lin:min:max:step."""
+    kind, *nums = spec.split(":")
+    nums = [int(x) for x in nums]
+    if kind == "geom" and len(nums) in (2, 3):
+        lo, hi, step = nums[0], nums[1], nums[2] if len(nums) == 3 else 2
+        if lo < 1 or step < 2:
+            raise ValueError(spec)
+        sizes = []
+        while lo <= hi:
+            sizes.append(lo)
+            lo *= step
+        return sizes
+    if kind == "lin" and len(nums) == 3 and nums[0] >= 1 and nums[2] >= 1:
+        return list(range(nums[0], nums[1] + 1, nums[2]))
+    raise ValueError(spec)
+
+
+def file_hash(path):
+    h = hashlib.sha256()
+    with open(path, "rb") as f:
+        for block in iter(lambda: f.read(1 << 20), b""):
+            h.update(block)
+    return h.hexdigest()
+
+
+def git_commit():
+    try:
+        return subprocess.run(["git", "-C", ROOT, "rev-parse", "--short", "HEAD"],
+                              capture_output=True, text=True, check=True).stdout.strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def build_points(args):
+    sizes = []
+    for spec in args.sizes:
+        sizes.extend(expand_sizes(spec))
+    procs = [int(p) for p in args.procs.split(",")]
+    algos = args.algos.split(",")
+    platforms = args.platforms.split(",") if args.launcher == "smpirun" else ["native"]
+
+    bench_sha = file_hash(args.bench)
+    params_sha = file_hash(args.params)
+    platform_sha = {p: (file_hash(p) if p != "native" else "") for p in platforms}
+
+    points = []
+    for platform, P, algo, m in product(platforms, procs, algos, sizes):
+        point = {
+            "platform": platform, "P": P, "algo": algo, "m": m,
+            "warmup": args.warmup, "iters": args.iters, "seg": args.seg,
+            "launcher": args.launcher, "launcher_args": args.launcher_args,
+            "bench_sha": bench_sha, "params": args.params, "params_sha": params_sha,
+            "platform_sha": platform_sha[platform],
+        }
+        point["key"] = hashlib.sha256(json.dumps(point, sort_keys=True).encode()).hexdigest()[:20]
+        points.append(point)
+    return points
+
+
+def command(args, point, out_path):
+    bench = [args.bench, "--sizes", f"lin:{point['m']}:{point['m']}:1", "--algos", point["algo"],
+             "--warmup", str(point["warmup"]), "--iters", str(point["iters"]),
+             "--params", args.params, "--format", "csv", "--out", out_path]
+    if point["seg"]:
+        bench += ["--seg", str(point["seg"])]
+    extra = shlex.split(args.launcher_args)
+    if args.launcher == "smpirun":
+        return ["smpirun", "-platform", point["platform"], "-n", str(point["P"])] + extra + bench
+    return ["mpirun", "-n", str(point["P"])] + extra + bench
+
+
+def run_sweep(args, points):
+    """Runs the uncached points, at most args.cores cores' worth at a time."""
+    os.makedirs(args.cache, exist_ok=True)
+    todo = [p for p in points if args.force or not os.path.exists(os.path.join(args.cache, p["key"] + ".json"))]
+    print(f"{len(points)} points, {len(points) - len(todo)} cached, {len(todo)} to run on {args.cores} cores")
+
+    commit, host = git_commit(), socket.gethostname()
+    cost = (lambda p: 1) if args.launcher == "smpirun" else (lambda p: p["P"])
+    running, used, failed, done = [], 0, 0, 0
+    todo.reverse()
+    while todo or running:
+        # Start what fits; a point larger than the whole budget runs alone
+        while todo and (used + cost(todo[-1]) <= args.cores or not running):
+            p = todo.pop()
+            tmp = os.path.join(args.cache, p["key"] + ".csv.part")
+            log = open(os.path.join(args.cache, p["key"] + ".log"), "w")
+            proc = subprocess.Popen(command(args, p, tmp), cwd=ROOT, stdout=log, stderr=subprocess.STDOUT)
+            running.append((proc, p, tmp, log, time.time()))
+            used += cost(p)
+
+        time.sleep(0.05)
+        for entry in [e for e in running if e[0].poll() is not None]:
+            proc, p, tmp, log, started = entry
+            running.remove(entry)
+            used -= cost(p)
+            log.close()
+            done += 1
+            if proc.returncode != 0 or not os.path.exists(tmp):
+                failed += 1
+                print(f"  FAILED {p['algo']} P={p['P']} m={p['m']} {p['platform']} "
+                      f"(see {os.path.join(args.cache, p['key'] + '.log')})", file=sys.stderr)
+                continue
+            # The .json is written last: a point only counts as cached once both files exist
+            os.replace(tmp, os.path.join(args.cache, p["key"] + ".csv"))
+            prov = dict(p, git_commit=commit, host=host, wall_s=round(time.time() - started, 3),
+                        run_at=datetime.now(timezone.utc).isoformat(timespec="seconds"))
+            with open(os.path.join(args.cache, p["key"] + ".json"), "w") as f:
+                json.dump(prov, f, sort_keys=True)
+            if done % 50 == 0 or not (todo or running):
+                print(f"  {done} run, {failed} failed")
+    return failed
+
+
+PROVENANCE = ["platform", "launcher", "git_commit", "bench_sha", "params", "params_sha",
+              "platform_sha", "seg", "host", "run_at", "wall_s", "key"]
+
+
+def merge(args, points):
+    """One row per point: the bench columns followed by the provenance columns."""
+    rows, header = [], None
+    for p in points:
+        base = os.path.join(args.cache, p["key"])
+        if not os.path.exists(base + ".json"):
+            continue
+        with open(base + ".json") as f:
+            prov = json.load(f)
+        with open(base + ".csv", newline="") as f:
+            reader = csv.DictReader(f)
+            header = header or reader.fieldnames
+            for row in reader:
+                row.update({k: prov.get(k, "") for k in PROVENANCE})
+                rows.append(row)
+
+    with open(args.out, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=(header or []) + PROVENANCE)
+        writer.writeheader()
+        writer.writerows(rows)
+    print(f"{len(rows)} rows written to {args.out}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Parallel (platform, P, algorithm, m) sweep of ./bench")
+    parser.add_argument("--procs", required=True, help="comma separated process counts, e.g. 4,8,16")
+    parser.add_argument("--sizes", action="append", required=True,
+                        help="geom:min:max[:factor] or lin:min:max:step in doubles; may be repeated")
+    parser.add_argument("--algos", default="lin,rab,rnos,rs,rd,tree,dbt,suara", help="bench --algos names, one point each")
+    parser.add_argument("--platforms", default="network_configuration_estimation/platform.xml",
+                        help="comma separated SimGrid platform files (smpirun only)")
+    parser.add_argument("--warmup", type=int, default=5)
+    parser.add_argument("--iters", type=int, default=50)
+    parser.add_argument("--seg", type=int, default=0, help="bench --seg, 0 keeps its default")
+    parser.add_argument("--params", default="data_store/sample.csv", help="alpha/beta/gamma for the predictions")
+    parser.add_argument("--bench", default="./bench")
+    parser.add_argument("--launcher", choices=["smpirun", "mpirun"], default="smpirun")
+    parser.add_argument("--launcher-args", default="", help="extra launcher arguments, e.g. '-hostfile hosts'")
+    parser.add_argument("--cores", type=int, default=os.cpu_count())
+    parser.add_argument("--cache", default="data_store/sweep_cache")
+    parser.add_argument("--out", default="data_store/sweep.csv")
+    parser.add_argument("--force", action="store_true", help="re-run points that are already cached")
+    args = parser.parse_args()
+
+    # Paths are taken relative to the repository root, where bench runs
+    os.chdir(ROOT)
+    try:
+        points = build_points(args)
+    except (OSError, ValueError) as e:
+        parser.error(str(e))
+    failed = run_sweep(args, points)
+    merge(args, points)
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -1,98 +1,177 @@
 #include "rabenseifner_allreduce.h"
+#include "reduce_ops.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 
-void rabenseifner_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Comm comm) {
-    int rank, size;
+// Power-of-2 core of size ranks: the first 2*rem ranks pair up, even ranks hand
+// their data to the odd neighbour and sit out the main phases (newrank -1)
+static int core_rank(int rank, int size, int *pof2_out, int *rem_out) {
+    int pof2 = 1;
+    while (pof2 * 2 <= size) pof2 *= 2;
+    int rem = size - pof2;
+    *pof2_out = pof2;
+    *rem_out = rem;
+    if (rank < 2 * rem) return (rank % 2 == 0) ? -1 : rank / 2;
+    return rank - rem;
+}
+
+static int core_partner(int newpartner, int rem) {
+    return (newpartner < rem) ? newpartner * 2 + 1 : newpartner + rem;
+}
+
+// Window [recv_offset, recv_offset + recv_size) newrank is responsible for at every level.
+// Odd windows split into size/2 (lower) and size - size/2 (upper); win_offset/win_size
+// keep every level's window so the allgather can retrace the exact splits.
+static void core_windows(int newrank, int pof2, ll count, ll *win_offset, ll *win_size, ll *shard_off, ll *shard_len) {
+    ll recv_offset = 0, recv_size = count;
+    int level = 0;
+    for (int mask = 1; mask < pof2; mask *= 2) {
+        ll lower = recv_size / 2;
+        win_offset[level] = recv_offset;
+        win_size[level] = recv_size;
+        if (newrank < (newrank ^ mask)) {
+            recv_size = lower;
+        } else {
+            recv_offset += lower;
+            recv_size -= lower;
+        }
+        level++;
+    }
+    *shard_off = recv_offset;
+    *shard_len = recv_size;
+}
+
+void rabenseifner_reduce_scatter(void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                                 ll *shard_off, ll *shard_len) {
+    int rank, size, type_size;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
+    MPI_Type_size(datatype, &type_size);
+    reduce_fn reduce = get_reduce_fn_or_abort(datatype, op, comm);
 
-    // Check power of 2
-    if ((size & (size-1)) != 0) {
-        if (rank == 0) {
-            fprintf(stderr, "Rabenseifner requires power-of-2 processes\n");
+    char *recv_buf = (char*)recvbuf;
+    char *tempbuf = (char*)reduce_alloc(count * type_size);
+
+    // Fold to the power-of-2 core
+    int pof2, rem;
+    int newrank = core_rank(rank, size, &pof2, &rem);
+    if (rank < 2 * rem) {
+        if (rank % 2 == 0) {
+            MPI_Send(recv_buf, count, datatype, rank + 1, 1, comm);
+        } else {
+            MPI_Recv(tempbuf, count, datatype, rank - 1, 1, comm, MPI_STATUS_IGNORE);
+            reduce_apply(reduce, recv_buf, tempbuf, count, type_size);
         }
-        MPI_Abort(comm, 1);
     }
 
-    double *send_buf = (double*)sendbuf;
-    double *recv_buf = (double*)recvbuf;
-    
-    memcpy(recv_buf, send_buf, count * sizeof(double));
-    double *tempbuf = (double*)malloc(count * sizeof(double));
-
-    ll recv_size = count;
-    ll recv_offset = 0;
-    ll send_offset = 0;
-    int mask = 1;
-
-    // PHASE 1: REDUCE-SCATTER
-    while(mask < size) {
-        int partner = rank ^ mask;
-        recv_size /= 2;
-
-        if (rank < partner) {
-            send_offset = recv_offset + recv_size;
-            
-            MPI_Request send_req, recv_req;
-            MPI_Irecv(tempbuf, recv_size, MPI_DOUBLE, partner, 0, comm, &recv_req);
-            MPI_Isend(&recv_buf[send_offset], recv_size, MPI_DOUBLE, partner, 0, comm, &send_req);
-            MPI_Wait(&recv_req, MPI_STATUS_IGNORE);
-            MPI_Wait(&send_req, MPI_STATUS_IGNORE);
+    *shard_off = 0;
+    *shard_len = 0;
+    if (newrank != -1) {
+        ll recv_size = count;
+        ll recv_offset = 0;
+        int mask = 1;
+
+        // Keep one half of the window, ship the other
+        while(mask < pof2) {
+            int newpartner = newrank ^ mask;
+            int partner = core_partner(newpartner, rem);
+            ll lower = recv_size / 2;
+            ll upper = recv_size - lower;
 
-            for (ll i = 0; i < recv_size; i++) {
-                recv_buf[recv_offset+i] += tempbuf[i];
+            ll send_offset, send_size;
+            if (newrank < newpartner) {
+                // keep the lower half, ship the upper half
+                send_offset = recv_offset + lower;
+                send_size = upper;
+                recv_size = lower;
+            } else {
+                // keep the upper half, ship the lower half
+                send_offset = recv_offset;
+                send_size = lower;
+                recv_offset += lower;
+                recv_size = upper;
             }
-        } else {
-            send_offset = recv_offset;
-            recv_offset += recv_size;
-            
+
             MPI_Request send_req, recv_req;
-            MPI_Irecv(tempbuf, recv_size, MPI_DOUBLE, partner, 0, comm, &recv_req);
-            MPI_Isend(&recv_buf[send_offset], recv_size, MPI_DOUBLE, partner, 0, comm, &send_req);
+            MPI_Irecv(tempbuf, recv_size, datatype, partner, 0, comm, &recv_req);
+            MPI_Isend(recv_buf + send_offset * type_size, send_size, datatype, partner, 0, comm, &send_req);
             MPI_Wait(&recv_req, MPI_STATUS_IGNORE);
             MPI_Wait(&send_req, MPI_STATUS_IGNORE);
 
-            for (ll i = 0; i < recv_size; i++) {
-                recv_buf[recv_offset+i] += tempbuf[i];
-            }
+            reduce_apply(reduce, recv_buf + recv_offset * type_size, tempbuf, recv_size, type_size);
+            mask *= 2;
         }
-        mask *= 2;
+        *shard_off = recv_offset;
+        *shard_len = recv_size;
     }
 
-    send_offset = recv_offset;
-    mask = size / 2;
+    free(tempbuf);
+}
+
+void rabenseifner_allgather(void *recvbuf, ll count, MPI_Datatype datatype, MPI_Comm comm) {
+    int rank, size, type_size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    MPI_Type_size(datatype, &type_size);
 
-    // PHASE 2: ALLGATHER
-    while(mask > 0) {
-        int partner = rank ^ mask;
+    char *recv_buf = (char*)recvbuf;
+    int pof2, rem;
+    int newrank = core_rank(rank, size, &pof2, &rem);
+
+    if (newrank != -1) {
+        ll win_offset[32], win_size[32];
+        ll recv_offset, recv_size;
+        core_windows(newrank, pof2, count, win_offset, win_size, &recv_offset, &recv_size);
+        int level = 0;
+        while ((1 << level) < pof2) level++;
+        int mask = pof2 / 2;
+
+        // Retrace the windows in reverse
+        while(mask > 0) {
+            int newpartner = newrank ^ mask;
+            int partner = core_partner(newpartner, rem);
+            level--;
+            ll lower = win_size[level] / 2;
+            ll upper = win_size[level] - lower;
+
+            ll partnerValue_offset, partnerValue_size;
+            if (newrank < newpartner) {
+                partnerValue_offset = win_offset[level] + lower;
+                partnerValue_size = upper;
+            } else {
+                partnerValue_offset = win_offset[level];
+                partnerValue_size = lower;
+            }
 
-        if (rank < partner) {
-            send_offset = recv_offset;
-            ll partnerValue_offset = recv_offset + recv_size;
-            
-            MPI_Request send_req, recv_req;
-            MPI_Irecv(&recv_buf[partnerValue_offset], recv_size, MPI_DOUBLE, partner, 0, comm, &recv_req);
-            MPI_Isend(&recv_buf[send_offset], recv_size, MPI_DOUBLE, partner, 0, comm, &send_req);
-            MPI_Wait(&recv_req, MPI_STATUS_IGNORE);
-            MPI_Wait(&send_req, MPI_STATUS_IGNORE);
-        } else {
-            send_offset = recv_offset;
-            ll partnerValue_offset = recv_offset - recv_size;
-            
             MPI_Request send_req, recv_req;
-            MPI_Irecv(&recv_buf[partnerValue_offset], recv_size, MPI_DOUBLE, partner, 0, comm, &recv_req);
-            MPI_Isend(&recv_buf[send_offset], recv_size, MPI_DOUBLE, partner, 0, comm, &send_req);
+            MPI_Irecv(recv_buf + partnerValue_offset * type_size, partnerValue_size, datatype, partner, 0, comm, &recv_req);
+            MPI_Isend(recv_buf + recv_offset * type_size, recv_size, datatype, partner, 0, comm, &send_req);
             MPI_Wait(&recv_req, MPI_STATUS_IGNORE);
             MPI_Wait(&send_req, MPI_STATUS_IGNORE);
 
-            recv_offset = partnerValue_offset;
+            recv_offset = win_offset[level];
+            recv_size = win_size[level];
+            mask /= 2;
         }
+    }
 
-        recv_size *= 2;
-        mask /= 2;
+    // Unfold: hand the result back to the ranks that sat out
+    if (rank < 2 * rem) {
+        if (rank % 2 == 0) {
+            MPI_Recv(recv_buf, count, datatype, rank + 1, 2, comm, MPI_STATUS_IGNORE);
+        } else {
+            MPI_Send(recv_buf, count, datatype, rank - 1, 2, comm);
+        }
     }
+}
 
-    free(tempbuf);
-}
\ No newline at end of file
+void rabenseifner_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm) {
+    int type_size;
+    MPI_Type_size(datatype, &type_size);
+    if (!IS_IN_PLACE(sendbuf, recvbuf)) memcpy(recvbuf, sendbuf, count * type_size);
+
+    ll shard_off, shard_len;
+    rabenseifner_reduce_scatter(recvbuf, count, datatype, op, comm, &shard_off, &shard_len);
+    rabenseifner_allgather(recvbuf, count, datatype, comm);
+}
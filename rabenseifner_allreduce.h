@@ -3,6 +3,12 @@
 
 #include "macros.h"
 
-void rabenseifner_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Comm comm);
+void rabenseifner_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm);
 
-#endif
\ No newline at end of file
+// The two halves of rabenseifner_allreduce, in place on recvbuf (see execReduceScatter in macros.h).
+// Ranks folded out of the power-of-2 core get an empty shard; the allgather unfolds to them.
+void rabenseifner_reduce_scatter(void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                                 ll *shard_off, ll *shard_len);
+void rabenseifner_allgather(void *recvbuf, ll count, MPI_Datatype datatype, MPI_Comm comm);
+
+#endif
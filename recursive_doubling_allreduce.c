@@ -1,42 +1,67 @@
 #include "recursive_doubling_allreduce.h"
+#include "reduce_ops.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 
-void recursive_doubling_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Comm comm) {
-    int rank, size;
+void recursive_doubling_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm) {
+    int rank, size, type_size;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
+    MPI_Type_size(datatype, &type_size);
+    reduce_fn reduce = get_reduce_fn_or_abort(datatype, op, comm);
     
-    // Check power of 2
-    if ((size & (size-1)) != 0) {
-        if (rank == 0) {
-            fprintf(stderr, "Recursive Doubling requires power-of-2 processes\n");
+    char *send_buf = (char*)sendbuf;
+    char *recv_buf = (char*)recvbuf;
+    
+    if (!IS_IN_PLACE(send_buf, recv_buf)) memcpy(recv_buf, send_buf, count * type_size);
+    char *temp_buf = (char*)reduce_alloc(count * type_size);
+
+    // Fold to a power-of-2 core: the first 2*rem ranks pair up, even ranks
+    // hand their data to the odd neighbour and sit out the exchange rounds
+    int pof2 = 1;
+    while (pof2 * 2 <= size) pof2 *= 2;
+    int rem = size - pof2;
+    int newrank;
+
+    if (rank < 2 * rem) {
+        if (rank % 2 == 0) {
+            MPI_Send(recv_buf, count, datatype, rank + 1, 1, comm);
+            newrank = -1;
+        } else {
+            MPI_Recv(temp_buf, count, datatype, rank - 1, 1, comm, MPI_STATUS_IGNORE);
+            reduce_apply(reduce, recv_buf, temp_buf, count, type_size);
+            newrank = rank / 2;
         }
-        MPI_Abort(comm, 1);
+    } else {
+        newrank = rank - rem;
     }
     
-    double *send_buf = (double*)sendbuf;
-    double *recv_buf = (double*)recvbuf;
-    
-    memcpy(recv_buf, send_buf, count * sizeof(double));
-    double *temp_buf = (double*)malloc(count * sizeof(double));
-    
-    int mask = 1;
-    while (mask < size) {
-        int partner = rank ^ mask;
-        
-        MPI_Sendrecv(recv_buf, count, MPI_DOUBLE, partner, 0,
-                     temp_buf, count, MPI_DOUBLE, partner, 0,
-                     comm, MPI_STATUS_IGNORE);
-        
-        for (ll i = 0; i < count; i++) {
-            recv_buf[i] += temp_buf[i];
+    if (newrank != -1) {
+        int mask = 1;
+        while (mask < pof2) {
+            int newpartner = newrank ^ mask;
+            int partner = (newpartner < rem) ? newpartner * 2 + 1 : newpartner + rem;
+            
+            MPI_Sendrecv(recv_buf, count, datatype, partner, 0,
+                         temp_buf, count, datatype, partner, 0,
+                         comm, MPI_STATUS_IGNORE);
+            
+            reduce_apply(reduce, recv_buf, temp_buf, count, type_size);
+            
+            mask <<= 1;
+        }
+    }
+
+    // Unfold: hand the result back to the ranks that sat out
+    if (rank < 2 * rem) {
+        if (rank % 2 == 0) {
+            MPI_Recv(recv_buf, count, datatype, rank + 1, 2, comm, MPI_STATUS_IGNORE);
+        } else {
+            MPI_Send(recv_buf, count, datatype, rank - 1, 2, comm);
         }
-        
-        mask <<= 1;
     }
     
     free(temp_buf);
-}
\ No newline at end of file
+}
@@ -0,0 +1,273 @@
+#include "reduce_ops.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+ll REDUCE_MT_THRESHOLD = DEFAULT_REDUCE_MT_THRESHOLD;
+int REDUCE_THREADS = 0;
+double REDUCE_MT_EFFICIENCY = DEFAULT_REDUCE_MT_EFFICIENCY;
+
+static MPI_Datatype bfloat16_type = MPI_DATATYPE_NULL;
+
+MPI_Datatype suara_bfloat16(void) {
+    if (bfloat16_type == MPI_DATATYPE_NULL) {
+        MPI_Type_contiguous(2, MPI_BYTE, &bfloat16_type);
+        MPI_Type_commit(&bfloat16_type);
+    }
+    return bfloat16_type;
+}
+
+#define OP_SUM(a, b)  ((a) + (b))
+#define OP_PROD(a, b) ((a) * (b))
+#define OP_MAX(a, b)  ((a) > (b) ? (a) : (b))
+#define OP_MIN(a, b)  ((a) < (b) ? (a) : (b))
+
+// One tight, restrict-qualified loop per (type, op) so the compiler can vectorise it
+#define DEFINE_REDUCE(type, tname, oname, OP)                                   \
+    static void reduce_##tname##_##oname(void *inout, const void *in, ll n) {  \
+        type *restrict a = (type *)inout;                                       \
+        const type *restrict b = (const type *)in;                              \
+        for (ll i = 0; i < n; i++) {                                            \
+            a[i] = OP(a[i], b[i]);                                              \
+        }                                                                       \
+    }
+
+#define DEFINE_REDUCE_ALL_OPS(type, tname)          \
+    DEFINE_REDUCE(type, tname, sum, OP_SUM)         \
+    DEFINE_REDUCE(type, tname, prod, OP_PROD)       \
+    DEFINE_REDUCE(type, tname, max, OP_MAX)         \
+    DEFINE_REDUCE(type, tname, min, OP_MIN)
+
+DEFINE_REDUCE_ALL_OPS(double, double)
+DEFINE_REDUCE_ALL_OPS(float, float)
+DEFINE_REDUCE_ALL_OPS(int, int)
+DEFINE_REDUCE_ALL_OPS(long long, ll)
+
+// bfloat16 is combined in float and rounded back to nearest-even
+static inline float bf16_to_float(uint16_t h) {
+    uint32_t bits = (uint32_t)h << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+static inline uint16_t float_to_bf16(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    if ((bits & 0x7fffffffu) > 0x7f800000u) {
+        return (uint16_t)((bits >> 16) | 0x40);    // keep NaNs quiet
+    }
+    bits += 0x7fffu + ((bits >> 16) & 1u);
+    return (uint16_t)(bits >> 16);
+}
+
+#define DEFINE_REDUCE_BF16(oname, OP)                                          \
+    static void reduce_bf16_##oname(void *inout, const void *in, ll n) {       \
+        uint16_t *restrict a = (uint16_t *)inout;                               \
+        const uint16_t *restrict b = (const uint16_t *)in;                      \
+        for (ll i = 0; i < n; i++) {                                            \
+            float x = bf16_to_float(a[i]), y = bf16_to_float(b[i]);             \
+            a[i] = float_to_bf16(OP(x, y));                                     \
+        }                                                                       \
+    }
+
+DEFINE_REDUCE_BF16(sum, OP_SUM)
+DEFINE_REDUCE_BF16(prod, OP_PROD)
+DEFINE_REDUCE_BF16(max, OP_MAX)
+DEFINE_REDUCE_BF16(min, OP_MIN)
+
+// ---------------------------------------------------------------------------
+// Explicit SIMD paths for float/double (the gradient types). Each kernel peels
+// scalar iterations until inout is vector aligned, so every store is aligned;
+// "in" may sit at any alignment and is loaded unaligned.
+// ---------------------------------------------------------------------------
+
+#define DEFINE_REDUCE_SIMD(attr, suffix, type, tname, oname, OP, VEC, WIDTH, ALIGN, LOADA, LOADU, STOREA, VOP) \
+    attr static void reduce_##suffix##_##tname##_##oname(void *inout, const void *in, ll n) {             \
+        type *restrict a = (type *)inout;                                                                   \
+        const type *restrict b = (const type *)in;                                                          \
+        ll i = 0;                                                                                           \
+        while (i < n && ((uintptr_t)(a + i) & ((ALIGN) - 1))) {                                             \
+            a[i] = OP(a[i], b[i]);                                                                          \
+            i++;                                                                                            \
+        }                                                                                                   \
+        for (; i + 2 * (WIDTH) <= n; i += 2 * (WIDTH)) {                                                    \
+            VEC x0 = VOP(LOADA(a + i), LOADU(b + i));                                                       \
+            VEC x1 = VOP(LOADA(a + i + (WIDTH)), LOADU(b + i + (WIDTH)));                                   \
+            STOREA(a + i, x0);                                                                              \
+            STOREA(a + i + (WIDTH), x1);                                                                    \
+        }                                                                                                   \
+        for (; i < n; i++) {                                                                                \
+            a[i] = OP(a[i], b[i]);                                                                          \
+        }                                                                                                   \
+    }
+
+#ifdef HAVE_X86_SIMD
+#define AVX2 __attribute__((target("avx2")))
+#define AVX512 __attribute__((target("avx512f")))
+
+DEFINE_REDUCE_SIMD(AVX2, avx2, double, double, sum,  OP_SUM,  __m256d, 4, 32, _mm256_load_pd, _mm256_loadu_pd, _mm256_store_pd, _mm256_add_pd)
+DEFINE_REDUCE_SIMD(AVX2, avx2, double, double, prod, OP_PROD, __m256d, 4, 32, _mm256_load_pd, _mm256_loadu_pd, _mm256_store_pd, _mm256_mul_pd)
+DEFINE_REDUCE_SIMD(AVX2, avx2, double, double, max,  OP_MAX,  __m256d, 4, 32, _mm256_load_pd, _mm256_loadu_pd, _mm256_store_pd, _mm256_max_pd)
+DEFINE_REDUCE_SIMD(AVX2, avx2, double, double, min,  OP_MIN,  __m256d, 4, 32, _mm256_load_pd, _mm256_loadu_pd, _mm256_store_pd, _mm256_min_pd)
+DEFINE_REDUCE_SIMD(AVX2, avx2, float,  float,  sum,  OP_SUM,  __m256,  8, 32, _mm256_load_ps, _mm256_loadu_ps, _mm256_store_ps, _mm256_add_ps)
+DEFINE_REDUCE_SIMD(AVX2, avx2, float,  float,  prod, OP_PROD, __m256,  8, 32, _mm256_load_ps, _mm256_loadu_ps, _mm256_store_ps, _mm256_mul_ps)
+DEFINE_REDUCE_SIMD(AVX2, avx2, float,  float,  max,  OP_MAX,  __m256,  8, 32, _mm256_load_ps, _mm256_loadu_ps, _mm256_store_ps, _mm256_max_ps)
+DEFINE_REDUCE_SIMD(AVX2, avx2, float,  float,  min,  OP_MIN,  __m256,  8, 32, _mm256_load_ps, _mm256_loadu_ps, _mm256_store_ps, _mm256_min_ps)
+
+DEFINE_REDUCE_SIMD(AVX512, avx512, double, double, sum,  OP_SUM,  __m512d, 8, 64,  _mm512_load_pd, _mm512_loadu_pd, _mm512_store_pd, _mm512_add_pd)
+DEFINE_REDUCE_SIMD(AVX512, avx512, double, double, prod, OP_PROD, __m512d, 8, 64,  _mm512_load_pd, _mm512_loadu_pd, _mm512_store_pd, _mm512_mul_pd)
+DEFINE_REDUCE_SIMD(AVX512, avx512, double, double, max,  OP_MAX,  __m512d, 8, 64,  _mm512_load_pd, _mm512_loadu_pd, _mm512_store_pd, _mm512_max_pd)
+DEFINE_REDUCE_SIMD(AVX512, avx512, double, double, min,  OP_MIN,  __m512d, 8, 64,  _mm512_load_pd, _mm512_loadu_pd, _mm512_store_pd, _mm512_min_pd)
+DEFINE_REDUCE_SIMD(AVX512, avx512, float,  float,  sum,  OP_SUM,  __m512,  16, 64, _mm512_load_ps, _mm512_loadu_ps, _mm512_store_ps, _mm512_add_ps)
+DEFINE_REDUCE_SIMD(AVX512, avx512, float,  float,  prod, OP_PROD, __m512,  16, 64, _mm512_load_ps, _mm512_loadu_ps, _mm512_store_ps, _mm512_mul_ps)
+DEFINE_REDUCE_SIMD(AVX512, avx512, float,  float,  max,  OP_MAX,  __m512,  16, 64, _mm512_load_ps, _mm512_loadu_ps, _mm512_store_ps, _mm512_max_ps)
+DEFINE_REDUCE_SIMD(AVX512, avx512, float,  float,  min,  OP_MIN,  __m512,  16, 64, _mm512_load_ps, _mm512_loadu_ps, _mm512_store_ps, _mm512_min_ps)
+#endif
+
+#ifdef HAVE_NEON
+#define NEON_ATTR
+
+DEFINE_REDUCE_SIMD(NEON_ATTR, neon, double, double, sum,  OP_SUM,  float64x2_t, 2, 16, vld1q_f64, vld1q_f64, vst1q_f64, vaddq_f64)
+DEFINE_REDUCE_SIMD(NEON_ATTR, neon, double, double, prod, OP_PROD, float64x2_t, 2, 16, vld1q_f64, vld1q_f64, vst1q_f64, vmulq_f64)
+DEFINE_REDUCE_SIMD(NEON_ATTR, neon, double, double, max,  OP_MAX,  float64x2_t, 2, 16, vld1q_f64, vld1q_f64, vst1q_f64, vmaxq_f64)
+DEFINE_REDUCE_SIMD(NEON_ATTR, neon, double, double, min,  OP_MIN,  float64x2_t, 2, 16, vld1q_f64, vld1q_f64, vst1q_f64, vminq_f64)
+DEFINE_REDUCE_SIMD(NEON_ATTR, neon, float,  float,  sum,  OP_SUM,  float32x4_t, 4, 16, vld1q_f32, vld1q_f32, vst1q_f32, vaddq_f32)
+DEFINE_REDUCE_SIMD(NEON_ATTR, neon, float,  float,  prod, OP_PROD, float32x4_t, 4, 16, vld1q_f32, vld1q_f32, vst1q_f32, vmulq_f32)
+DEFINE_REDUCE_SIMD(NEON_ATTR, neon, float,  float,  max,  OP_MAX,  float32x4_t, 4, 16, vld1q_f32, vld1q_f32, vst1q_f32, vmaxq_f32)
+DEFINE_REDUCE_SIMD(NEON_ATTR, neon, float,  float,  min,  OP_MIN,  float32x4_t, 4, 16, vld1q_f32, vld1q_f32, vst1q_f32, vminq_f32)
+#endif
+
+enum { SIMD_UNKNOWN = -1, SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512, SIMD_NEON };
+static int simd_level = SIMD_UNKNOWN;
+
+// CPUID is queried once; the answer is reused by every later get_reduce_fn()
+static int detect_simd(void) {
+    if (simd_level != SIMD_UNKNOWN) return simd_level;
+    simd_level = SIMD_SCALAR;
+#if defined(HAVE_X86_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) simd_level = SIMD_AVX512;
+    else if (__builtin_cpu_supports("avx2")) simd_level = SIMD_AVX2;
+#elif defined(HAVE_NEON)
+    simd_level = SIMD_NEON;
+#endif
+    return simd_level;
+}
+
+const char *reduce_simd_name(void) {
+    switch (detect_simd()) {
+        case SIMD_AVX512: return "avx512";
+        case SIMD_AVX2:   return "avx2";
+        case SIMD_NEON:   return "neon";
+        default:          return "scalar";
+    }
+}
+
+void *reduce_alloc(size_t bytes) {
+    void *p = NULL;
+    if (posix_memalign(&p, REDUCE_ALIGN, bytes > 0 ? bytes : REDUCE_ALIGN) != 0) return NULL;
+    return p;
+}
+
+#define PICK_OP(tname)                                  \
+    do {                                                \
+        if (op == MPI_SUM)  return reduce_##tname##_sum;  \
+        if (op == MPI_PROD) return reduce_##tname##_prod; \
+        if (op == MPI_MAX)  return reduce_##tname##_max;  \
+        if (op == MPI_MIN)  return reduce_##tname##_min;  \
+        return NULL;                                    \
+    } while (0)
+
+reduce_fn get_reduce_fn(MPI_Datatype datatype, MPI_Op op) {
+    int level = detect_simd();
+    (void)level;
+#ifdef HAVE_X86_SIMD
+    if (level == SIMD_AVX512) {
+        if (datatype == MPI_DOUBLE) PICK_OP(avx512_double);
+        if (datatype == MPI_FLOAT)  PICK_OP(avx512_float);
+    }
+    if (level == SIMD_AVX2) {
+        if (datatype == MPI_DOUBLE) PICK_OP(avx2_double);
+        if (datatype == MPI_FLOAT)  PICK_OP(avx2_float);
+    }
+#endif
+#ifdef HAVE_NEON
+    if (datatype == MPI_DOUBLE) PICK_OP(neon_double);
+    if (datatype == MPI_FLOAT)  PICK_OP(neon_float);
+#endif
+    if (datatype == MPI_DOUBLE) PICK_OP(double);
+    if (datatype == MPI_FLOAT)  PICK_OP(float);
+    if (datatype == MPI_INT)    PICK_OP(int);
+    if (datatype == MPI_LONG_LONG || datatype == MPI_INT64_T) PICK_OP(ll);
+    if (datatype == bfloat16_type && datatype != MPI_DATATYPE_NULL) PICK_OP(bf16);
+    return NULL;
+}
+
+reduce_fn get_reduce_fn_or_abort(MPI_Datatype datatype, MPI_Op op, MPI_Comm comm) {
+    reduce_fn fn = get_reduce_fn(datatype, op);
+    if (fn == NULL) {
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        if (rank == 0) {
+            fprintf(stderr, "Unsupported datatype/op pair for SUARA allreduce\n");
+        }
+        MPI_Abort(comm, 1);
+    }
+    return fn;
+}
+
+int reduce_threads(ll n) {
+#ifdef _OPENMP
+    if (n < REDUCE_MT_THRESHOLD) return 1;
+    int nthreads = (REDUCE_THREADS > 0) ? REDUCE_THREADS : omp_get_max_threads();
+    return nthreads > 1 ? nthreads : 1;
+#else
+    (void)n;
+    return 1;
+#endif
+}
+
+void reduce_apply(reduce_fn fn, void *inout, const void *in, ll n, int type_size) {
+    int nthreads = reduce_threads(n);
+    if (nthreads <= 1) {
+        fn(inout, in, n);
+        return;
+    }
+#ifdef _OPENMP
+    // Slice boundaries are multiples of REDUCE_ALIGN bytes so every thread's
+    // SIMD loop starts aligned and no two threads share a cache line
+    ll quantum = REDUCE_ALIGN / type_size > 0 ? REDUCE_ALIGN / type_size : 1;
+    ll blocks = (n + quantum - 1) / quantum;
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int t = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        ll lo = blocks * t / nt * quantum;
+        ll hi = blocks * (t + 1) / nt * quantum;
+        if (hi > n) hi = n;
+        if (lo < hi) {
+            fn((char *)inout + lo * type_size, (const char *)in + lo * type_size, hi - lo);
+        }
+    }
+#endif
+}
+
+double gamma_eff(double gamma, ll n) {
+    int nthreads = reduce_threads(n);
+    return gamma / (1.0 + (nthreads - 1) * REDUCE_MT_EFFICIENCY);
+}
+
@@ -0,0 +1,60 @@
+#ifndef REDUCE_OPS_H
+#define REDUCE_OPS_H
+
+#include "macros.h"
+#include <stddef.h>
+
+/**
+ * @brief Local combine step shared by every allreduce kernel.
+ *
+ * get_reduce_fn() resolves a (datatype, op) pair once per call to a
+ * specialised loop inout[i] = inout[i] (op) in[i], so the kernels never
+ * switch on the type per element.
+ *
+ * float and double SUM/PROD/MAX/MIN have explicit AVX-512, AVX2 and NEON
+ * loops; the widest one the CPU reports (CPUID, queried once) is used and
+ * every other pair falls back to a scalar loop the compiler can vectorise.
+ *
+ * Supported datatypes: MPI_DOUBLE, MPI_FLOAT, MPI_INT, MPI_LONG_LONG,
+ * MPI_INT64_T and suara_bfloat16().  Supported ops: MPI_SUM, MPI_PROD,
+ * MPI_MAX, MPI_MIN.
+ */
+
+typedef void (*reduce_fn)(void *inout, const void *in, ll n);
+
+reduce_fn get_reduce_fn(MPI_Datatype datatype, MPI_Op op);		//NULL if the pair is unsupported
+reduce_fn get_reduce_fn_or_abort(MPI_Datatype datatype, MPI_Op op, MPI_Comm comm);
+
+#define REDUCE_ALIGN 64
+#define DEFAULT_REDUCE_MT_THRESHOLD (1LL << 22)		//elements; below this a combine stays on one thread
+#define DEFAULT_REDUCE_MT_EFFICIENCY 0.5			//each extra thread adds this fraction of a core (the loop is memory bound)
+
+/**
+ * Multi-threaded combine (OpenMP). reduce_apply() splits combines of at least
+ * REDUCE_MT_THRESHOLD elements across REDUCE_THREADS threads (0 = OpenMP
+ * default) in REDUCE_ALIGN-sized pieces; smaller ones call fn directly.
+ * Built without OpenMP it always calls fn directly.
+ */
+extern ll REDUCE_MT_THRESHOLD;
+extern int REDUCE_THREADS;
+extern double REDUCE_MT_EFFICIENCY;
+
+void reduce_apply(reduce_fn fn, void *inout, const void *in, ll n, int type_size);
+
+// Number of threads reduce_apply() would use for a combine of n elements
+int reduce_threads(ll n);
+
+// gamma(n): the per-element combine cost the Hockney models should charge for a
+// combine of n elements, i.e. gamma divided by the expected thread speedup
+double gamma_eff(double gamma, ll n);
+
+// REDUCE_ALIGN-aligned allocation for kernel scratch buffers (release with free())
+void *reduce_alloc(size_t bytes);
+
+// Name of the SIMD path get_reduce_fn() dispatches to: "avx512", "avx2", "neon" or "scalar"
+const char *reduce_simd_name(void);
+
+// 2-byte bfloat16 datatype (upper half of an IEEE float), committed on first use
+MPI_Datatype suara_bfloat16(void);
+
+#endif
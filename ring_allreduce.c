@@ -1,67 +1,94 @@
 #include "ring_allreduce.h"
+#include "reduce_ops.h"
 #include <string.h>
 #include <stdlib.h>
 
-void ring_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Comm comm){
-    int rank, size;
+void ring_reduce_scatter(void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                         ll *shard_off, ll *shard_len) {
+    int rank, size, type_size;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
+    MPI_Type_size(datatype, &type_size);
+    reduce_fn reduce = get_reduce_fn_or_abort(datatype, op, comm);
 
-    // DEBUG: Open trace file
-    // char logname[64];
-    // sprintf(logname, "ring_trace_rank_%d.log", rank);
-    // FILE *trace = fopen(logname, "w");
-    // fprintf(trace, "=== RING ALLREDUCE START ===\n");
-    // fprintf(trace, "Rank %d, Size %d, Count %lld\n\n", rank, size, count);
-    
-    double *send_buf = (double*)sendbuf;
-    double *recv_buf = (double*)recvbuf;
-    
-    int chunk_size = count / size;
-    memcpy(recv_buf, send_buf, sizeof(double) * count);
+    char *recv_buf = (char*)recvbuf;
+
+    // Chunk i is [chunk_off[i], chunk_off[i+1]); the first count % size chunks hold one extra element
+    ll *chunk_off = (ll *) malloc(sizeof(ll) * (size + 1));
+    chunk_offsets(count, size, chunk_off);
+    ll max_chunk = chunk_off[1];
     
-    double* recv_chunk = (double *) malloc(sizeof(double) * chunk_size);
+    char *recv_chunk = (char *) reduce_alloc(type_size * max_chunk);
     
-    // Reduce Scatter
     // Perform size-1 steps
     for (int step = 0; step < size - 1; step++) {
         int send_chunk_idx = (rank - step + size) % size;
         int recv_chunk_idx = (rank - step - 1 + size) % size;
         int send_to = (rank + 1) % size;
         int recv_from = (rank - 1 + size) % size;
+        ll send_len = chunk_off[send_chunk_idx + 1] - chunk_off[send_chunk_idx];
+        ll recv_len = chunk_off[recv_chunk_idx + 1] - chunk_off[recv_chunk_idx];
         
         MPI_Request send_req, recv_req;
-        MPI_Isend(&recv_buf[send_chunk_idx * chunk_size], chunk_size, MPI_DOUBLE,
+        MPI_Isend(recv_buf + chunk_off[send_chunk_idx] * type_size, send_len, datatype,
                   send_to, 0, comm, &send_req);
-        MPI_Irecv(recv_chunk, chunk_size, MPI_DOUBLE,
+        MPI_Irecv(recv_chunk, recv_len, datatype,
                   recv_from, 0, comm, &recv_req);
         
         MPI_Wait(&send_req, MPI_STATUS_IGNORE);
         MPI_Wait(&recv_req, MPI_STATUS_IGNORE);
         
         // Reduce received chunk into result
-        for (int i = 0; i < chunk_size; i++) {
-            recv_buf[recv_chunk_idx * chunk_size + i] += recv_chunk[i];
-        }
+        reduce_apply(reduce, recv_buf + chunk_off[recv_chunk_idx] * type_size, recv_chunk, recv_len, type_size);
     }
+
+    // The last chunk received and reduced is the one this rank now holds in full
+    int own = (rank + 1) % size;
+    *shard_off = chunk_off[own];
+    *shard_len = chunk_off[own + 1] - chunk_off[own];
     
-    // AllGather
+    free(recv_chunk);
+    free(chunk_off);
+}
+
+void ring_allgather(void *recvbuf, ll count, MPI_Datatype datatype, MPI_Comm comm) {
+    int rank, size, type_size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    MPI_Type_size(datatype, &type_size);
+
+    char *recv_buf = (char*)recvbuf;
+    ll *chunk_off = (ll *) malloc(sizeof(ll) * (size + 1));
+    chunk_offsets(count, size, chunk_off);
+
     // Perform size-1 steps
     for (int step = 0; step < size - 1; step++) {
         int send_chunk_idx = (rank - step + 1 + size) % size;
         int recv_chunk_idx = (rank - step + size) % size;
         int send_to = (rank + 1) % size;
         int recv_from = (rank - 1 + size) % size;
+        ll send_len = chunk_off[send_chunk_idx + 1] - chunk_off[send_chunk_idx];
+        ll recv_len = chunk_off[recv_chunk_idx + 1] - chunk_off[recv_chunk_idx];
         
         MPI_Request send_req, recv_req;
-        MPI_Isend(&recv_buf[send_chunk_idx * chunk_size], chunk_size, MPI_DOUBLE,
+        MPI_Isend(recv_buf + chunk_off[send_chunk_idx] * type_size, send_len, datatype,
                   send_to, 1, comm, &send_req);
-        MPI_Irecv(&recv_buf[recv_chunk_idx * chunk_size], chunk_size, MPI_DOUBLE,
+        MPI_Irecv(recv_buf + chunk_off[recv_chunk_idx] * type_size, recv_len, datatype,
                   recv_from, 1, comm, &recv_req);
         
         MPI_Wait(&send_req, MPI_STATUS_IGNORE);
         MPI_Wait(&recv_req, MPI_STATUS_IGNORE);
     }
-    
-    free(recv_chunk);
-}
\ No newline at end of file
+
+    free(chunk_off);
+}
+
+void ring_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm){
+    int type_size;
+    MPI_Type_size(datatype, &type_size);
+    if (!IS_IN_PLACE(sendbuf, recvbuf)) memcpy(recvbuf, sendbuf, type_size * count);
+
+    ll shard_off, shard_len;
+    ring_reduce_scatter(recvbuf, count, datatype, op, comm, &shard_off, &shard_len);
+    ring_allgather(recvbuf, count, datatype, comm);
+}
@@ -3,6 +3,11 @@
 
 #include "macros.h"
 
-void ring_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Comm comm);
+void ring_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm);
 
-#endif
\ No newline at end of file
+// The two halves of ring_allreduce, in place on recvbuf (see execReduceScatter in macros.h)
+void ring_reduce_scatter(void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                         ll *shard_off, ll *shard_len);
+void ring_allgather(void *recvbuf, ll count, MPI_Datatype datatype, MPI_Comm comm);
+
+#endif
@@ -1,63 +1,124 @@
 #include "ring_seg_allreduce.h"
+#include "reduce_ops.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
 
-void ring_seg_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Comm comm) {
-    // printf("Using dummy ring Implementation instead of ring segmentation implementation\n");
-
-    int rank, size;
+/**
+ * @brief Segmented (pipelined) ring allreduce.
+ *
+ * Same 2(P-1) step schedule as ring_allreduce: at step s a rank sends chunk
+ * (rank - s) and receives chunk (rank - s - 1); the first P-1 steps reduce,
+ * the last P-1 steps only copy (allgather). Every chunk is cut into SEG_SIZE
+ * element segments and every segment of a step is in flight at once. As soon
+ * as segment k of step s has arrived and been reduced it is forwarded as
+ * segment k of step s+1, so the reduction of segment k overlaps the transfer
+ * of segment k+1. This is the schedule hockneytime_rs() models with ms = SEG_SIZE.
+ */
+void ring_seg_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm) {
+    int rank, size, type_size;
     MPI_Comm_rank(comm, &rank);
     MPI_Comm_size(comm, &size);
-    
-    double *send_buf = (double*)sendbuf;
-    double *recv_buf = (double*)recvbuf;
-    
-    int chunk_size = count / size;
-    memcpy(recv_buf, send_buf, sizeof(double) * count);
-    
-    double* recv_chunk = (double *) malloc(sizeof(double) * chunk_size);
-    
-    // Reduce Scatter
-    // Perform size-1 steps
-    for (int step = 0; step < size - 1; step++) {
-        int send_chunk_idx = (rank - step + size) % size;
-        int recv_chunk_idx = (rank - step - 1 + size) % size;
-        int send_to = (rank + 1) % size;
-        int recv_from = (rank - 1 + size) % size;
-        
-        MPI_Request send_req, recv_req;
-        MPI_Isend(&recv_buf[send_chunk_idx * chunk_size], chunk_size, MPI_DOUBLE,
-                  send_to, 0, comm, &send_req);
-        MPI_Irecv(recv_chunk, chunk_size, MPI_DOUBLE,
-                  recv_from, 0, comm, &recv_req);
-        
-        MPI_Wait(&send_req, MPI_STATUS_IGNORE);
-        MPI_Wait(&recv_req, MPI_STATUS_IGNORE);
-        
-        // Reduce received chunk into result
-        for (int i = 0; i < chunk_size; i++) {
-            recv_buf[recv_chunk_idx * chunk_size + i] += recv_chunk[i];
-        }
+    MPI_Type_size(datatype, &type_size);
+    reduce_fn reduce = get_reduce_fn_or_abort(datatype, op, comm);
+
+    char *send_buf = (char*)sendbuf;
+    char *recv_buf = (char*)recvbuf;
+
+    if (!IS_IN_PLACE(send_buf, recv_buf)) memcpy(recv_buf, send_buf, type_size * count);
+    if (size == 1) return;
+
+    // Chunk i is [chunk_off[i], chunk_off[i+1]); the first count % size chunks hold one extra element
+    ll *chunk_off = (ll *) malloc(sizeof(ll) * (size + 1));
+    chunk_offsets(count, size, chunk_off);
+    ll max_chunk = chunk_off[1];
+    if (max_chunk == 0) {
+        free(chunk_off);
+        return;
+    }
+
+    ll seg_size = (SEG_SIZE > 0) ? SEG_SIZE : max_chunk;
+    if (seg_size > max_chunk) seg_size = max_chunk;
+    // Chunks differ by at most one element, so their segment counts differ by at most one
+    int max_nseg = (int)((max_chunk + seg_size - 1) / seg_size);
+
+    int send_to = (rank + 1) % size;
+    int recv_from = (rank - 1 + size) % size;
+    int nsteps = 2 * (size - 1);
+
+    char *recv_chunk = (char *) reduce_alloc(type_size * max_chunk);
+    MPI_Request *send_req = (MPI_Request *) malloc(sizeof(MPI_Request) * max_nseg);
+    MPI_Request *recv_req = (MPI_Request *) malloc(sizeof(MPI_Request) * max_nseg);
+    for (int k = 0; k < max_nseg; k++) {
+        send_req[k] = MPI_REQUEST_NULL;
+        recv_req[k] = MPI_REQUEST_NULL;
     }
-    
-    // AllGather
-    // Perform size-1 steps
-    for (int step = 0; step < size - 1; step++) {
-        int send_chunk_idx = (rank - step + 1 + size) % size;
-        int recv_chunk_idx = (rank - step + size) % size;
-        int send_to = (rank + 1) % size;
-        int recv_from = (rank - 1 + size) % size;
-        
-        MPI_Request send_req, recv_req;
-        MPI_Isend(&recv_buf[send_chunk_idx * chunk_size], chunk_size, MPI_DOUBLE,
-                  send_to, 1, comm, &send_req);
-        MPI_Irecv(&recv_buf[recv_chunk_idx * chunk_size], chunk_size, MPI_DOUBLE,
-                  recv_from, 1, comm, &recv_req);
-        
-        MPI_Wait(&send_req, MPI_STATUS_IGNORE);
-        MPI_Wait(&recv_req, MPI_STATUS_IGNORE);
+
+    // Step 0: post every segment receive, then stream out our own chunk
+    int send_chunk_idx = rank;
+    int recv_chunk_idx = (rank - 1 + size) % size;
+    ll send_len = chunk_off[send_chunk_idx + 1] - chunk_off[send_chunk_idx];
+    ll recv_len = chunk_off[recv_chunk_idx + 1] - chunk_off[recv_chunk_idx];
+    for (int k = 0; k * seg_size < recv_len; k++) {
+        ll seg_off = k * seg_size;
+        ll seg_len = (seg_off + seg_size <= recv_len) ? seg_size : recv_len - seg_off;
+        MPI_Irecv(recv_chunk + seg_off * type_size, seg_len, datatype, recv_from, 0, comm, &recv_req[k]);
+    }
+    for (int k = 0; k * seg_size < send_len; k++) {
+        ll seg_off = k * seg_size;
+        ll seg_len = (seg_off + seg_size <= send_len) ? seg_size : send_len - seg_off;
+        MPI_Isend(recv_buf + (chunk_off[send_chunk_idx] + seg_off) * type_size, seg_len, datatype,
+                  send_to, 0, comm, &send_req[k]);
     }
-    
+
+    for (int step = 0; step < nsteps; step++) {
+        recv_chunk_idx = (rank - step - 1 + 2 * size) % size;
+        int next_recv_chunk_idx = (rank - step - 2 + 2 * size) % size;
+        recv_len = chunk_off[recv_chunk_idx + 1] - chunk_off[recv_chunk_idx];
+        ll next_recv_len = chunk_off[next_recv_chunk_idx + 1] - chunk_off[next_recv_chunk_idx];
+        int reducing = (step < size - 1);
+        int next_reduce = (step + 1 < size - 1);
+        int has_next = (step + 1 < nsteps);
+
+        for (int k = 0; k < max_nseg; k++) {
+            ll seg_off = k * seg_size;
+            ll seg_len = (seg_off >= recv_len) ? 0
+                       : (seg_off + seg_size <= recv_len) ? seg_size : recv_len - seg_off;
+            char *seg = recv_buf + (chunk_off[recv_chunk_idx] + seg_off) * type_size;
+
+            if (seg_len > 0) {
+                MPI_Wait(&recv_req[k], MPI_STATUS_IGNORE);
+
+                // Reduce-scatter steps land in recv_chunk, allgather steps land in place
+                if (reducing) {
+                    reduce_apply(reduce, seg, recv_chunk + seg_off * type_size, seg_len, type_size);
+                }
+            }
+
+            if (!has_next) continue;
+
+            // The previous send of segment k must be done before its slot
+            // (or, in the allgather phase, its destination) is reused
+            MPI_Wait(&send_req[k], MPI_STATUS_IGNORE);
+
+            if (seg_off < next_recv_len) {
+                ll next_len = (seg_off + seg_size <= next_recv_len) ? seg_size : next_recv_len - seg_off;
+                char *next_dst = next_reduce ? recv_chunk + seg_off * type_size
+                                             : recv_buf + (chunk_off[next_recv_chunk_idx] + seg_off) * type_size;
+                MPI_Irecv(next_dst, next_len, datatype, recv_from, 0, comm, &recv_req[k]);
+            }
+
+            // Forward the segment we just finished as segment k of the next step
+            if (seg_len > 0) {
+                MPI_Isend(seg, seg_len, datatype, send_to, 0, comm, &send_req[k]);
+            }
+        }
+    }
+
+    MPI_Waitall(max_nseg, send_req, MPI_STATUSES_IGNORE);
+
+    free(recv_req);
+    free(send_req);
     free(recv_chunk);
-}
\ No newline at end of file
+    free(chunk_off);
+}
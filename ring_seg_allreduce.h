@@ -3,6 +3,6 @@
 
 #include "macros.h"
 
-void ring_seg_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Comm comm);
+void ring_seg_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm);
 
 #endif
\ No newline at end of file
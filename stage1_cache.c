@@ -0,0 +1,143 @@
+#include "stage1_cache.h"
+#include "est_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+typedef struct {
+    ll P, bucket;
+    unsigned long long fingerprint;
+    ll ans[3];
+    double time;
+    int used;
+} cache_slot;
+
+static cache_slot *slots = NULL;
+static ll capacity = 0, filled = 0;		// capacity is a power of two, kept at most half full
+static FILE *persist_fp = NULL;
+
+static ll slot_index(ll P, ll bucket, unsigned long long fingerprint) {
+    unsigned long long h = fingerprint;
+    h ^= (unsigned long long)P * 0x9E3779B97F4A7C15ULL;
+    h ^= (unsigned long long)bucket * 0xC2B2AE3D27D4EB4FULL;
+    h ^= h >> 29;
+    return (ll)(h & (unsigned long long)(capacity - 1));
+}
+
+static cache_slot *find_slot(ll P, ll bucket, unsigned long long fingerprint) {
+    ll i = slot_index(P, bucket, fingerprint);
+    while (slots[i].used &&
+           !(slots[i].P == P && slots[i].bucket == bucket && slots[i].fingerprint == fingerprint)) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &slots[i];
+}
+
+static void grow(void) {
+    cache_slot *old = slots;
+    ll old_capacity = capacity;
+
+    capacity = capacity ? 2 * capacity : 64;
+    slots = (cache_slot *) calloc(capacity, sizeof(cache_slot));
+    for (ll i = 0; i < old_capacity; i++) {
+        if (old[i].used) *find_slot(old[i].P, old[i].bucket, old[i].fingerprint) = old[i];
+    }
+    free(old);
+}
+
+static cache_slot *insert(ll P, ll bucket, unsigned long long fingerprint) {
+    if (2 * (filled + 1) > capacity) grow();
+    cache_slot *s = find_slot(P, bucket, fingerprint);
+    if (!s->used) {
+        s->used = 1;
+        s->P = P;
+        s->bucket = bucket;
+        s->fingerprint = fingerprint;
+        filled++;
+    }
+    return s;
+}
+
+void stage1_cache_open(const char *path, int persist) {
+    stage1_cache_close();
+
+    FILE *fp = fopen(path, "r");
+    if (fp != NULL) {
+        char line[256];
+        while (fgets(line, sizeof(line), fp)) {
+            ll P, bucket, ans[3];
+            unsigned long long fingerprint;
+            double time;
+            // the header and malformed lines do not parse
+            if (sscanf(line, "%lld,%lld,%llx,%lld,%lld,%lld,%lf", &P, &bucket, &fingerprint,
+                       &ans[0], &ans[1], &ans[2], &time) != 7)
+                continue;
+            cache_slot *s = insert(P, bucket, fingerprint);
+            memcpy(s->ans, ans, sizeof(ans));
+            s->time = time;
+        }
+        fclose(fp);
+    }
+
+    if (persist) {
+        int fresh = (fp == NULL);
+        persist_fp = fopen(path, "a");
+        if (persist_fp == NULL) {
+            fprintf(stderr, "stage1_cache_open: cannot write %s, decisions stay in memory\n", path);
+        } else if (fresh) {
+            fprintf(persist_fp, "P,bucket,fingerprint,algorow,algocol,Pc,time\n");
+        }
+    }
+}
+
+void stage1_cache_close(void) {
+    if (persist_fp != NULL) fclose(persist_fp);
+    persist_fp = NULL;
+    free(slots);
+    slots = NULL;
+    capacity = filled = 0;
+}
+
+ll stage1_bucket(ll m) {
+    ll b = 0;
+    while (m > 1) {
+        m >>= 1;
+        b++;
+    }
+    return b;
+}
+
+// 2^b * sqrt(2) in double, so no shift or cast overflows whatever the bucket
+ll stage1_bucket_mid(ll bucket) {
+    double mid = 1.41421356237;
+    for (ll b = 0; b < bucket && mid < (double)LLONG_MAX; b++) mid *= 2;
+    if (mid >= (double)LLONG_MAX) return LLONG_MAX;
+    return (ll)mid;
+}
+
+double Stage1_cached(ll P, ll m, ll ms, ll *ans) {
+    ll bucket = stage1_bucket(m);
+    unsigned long long fingerprint = calibration_fingerprint(ms);
+
+    if (capacity == 0) grow();
+    cache_slot *s = find_slot(P, bucket, fingerprint);
+    if (!s->used) {
+        // geometric midpoint of [2^b, 2^(b+1)), so the decision does not depend on which m came first
+        ll m_mid = stage1_bucket_mid(bucket);
+        ll fresh[3];
+        double time = Stage1(P, m_mid, ms, fresh);
+
+        s = insert(P, bucket, fingerprint);
+        memcpy(s->ans, fresh, sizeof(fresh));
+        s->time = time;
+        if (persist_fp != NULL) {
+            fprintf(persist_fp, "%lld,%lld,%llx,%lld,%lld,%lld,%.9g\n", P, bucket, fingerprint,
+                    fresh[0], fresh[1], fresh[2], time);
+            fflush(persist_fp);
+        }
+    }
+
+    memcpy(ans, s->ans, 3 * sizeof(ll));
+    return s->time;
+}
@@ -0,0 +1,34 @@
+#ifndef STAGE1_CACHE_H
+#define STAGE1_CACHE_H
+
+#include "macros.h"
+
+/**
+ * @brief Memoised Stage1 decisions.
+ *
+ * A decision (algorow, algocol, Pc) is keyed by P, the message-size bucket
+ * floor(log2(m)) and calibration_fingerprint(ms), so every m in
+ * [2^b, 2^(b+1)) shares the decision Stage1 makes for the bucket's
+ * geometric midpoint. Lookups are O(1) in an in-memory hash table.
+ *
+ * stage1_cache_open() loads a csv of earlier decisions; when persist is set,
+ * every new decision is appended to it, so later launches skip Stage1
+ * entirely. Let one rank persist (e.g. rank 0): the others compute the same
+ * decisions from the same parameters, or receive them via Stage1_root.
+ *
+ * Usage:
+ *     my_init("./data_store/sample.csv");
+ *     stage1_cache_open(STAGE1_CACHE_PATH, rank == 0);
+ *     Stage1_cached(P, m, ms, ans);
+ */
+
+#define STAGE1_CACHE_PATH "./data_store/stage1_cache.csv"
+
+void stage1_cache_open(const char *path, int persist);
+void stage1_cache_close(void);
+
+ll stage1_bucket(ll m);									//floor(log2(m)), 0 for m <= 1
+ll stage1_bucket_mid(ll bucket);						//geometric midpoint of [2^b, 2^(b+1)), saturated at LLONG_MAX, at least 1
+double Stage1_cached(ll P, ll m, ll ms, ll *ans);		//same ans layout as Stage1; returns the predicted time at the bucket midpoint
+
+#endif
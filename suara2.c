@@ -2,8 +2,16 @@
 #include <stdlib.h>
 #include <mpi.h>
 #include <math.h>
+#include <string.h>
 #include "est_time.h"
 #include "macros.h"
+#include "topo_allreduce.h"
+#include "grid_allreduce.h"
+#include "stage1_cache.h"
+#include "calibration.h"
+#include "adaptive.h"
+#include "explore.h"
+#include "fusion.h"
 
 /**
  * @brief Performs a two-step hierarchical Allreduce on a generalized grid (R x C).
@@ -11,6 +19,38 @@
  * * Usage:
  * 	smpicc hierarchical_allreduce.c 
  * 	smpirun -n <P> -platform platform.xml ./a.out <Pc>
+ *
+ * With "topo" as the second argument the grid follows the machine instead:
+ * rows are the ranks of one node (MPI_COMM_TYPE_SHARED), columns span nodes,
+ * and Stage1_topo picks the intra/inter pair with per-level parameters:
+ * 	smpirun -n <P> -platform platform_multinode.xml -hostfile hostfile_multinode ./suara2 <m> topo
+ *
+ * With "2d" Stage1_2d also scores the reduce-scatter scheme (row reduce-scatter,
+ * column allreduce of the m/Pc shard, row allgather) and the concurrent dual-orientation
+ * scheme (half row-then-column, half column-then-row) and grid_allreduce_2d runs the winner:
+ * 	smpirun -n <P> -platform platform.xml ./suara2 <m> 2d
+ *
+ * With "grid <k>" Stage1_kd splits P into up to k grid dimensions:
+ * 	smpirun -n <P> -platform platform.xml ./suara2 <m> grid 3
+ *
+ * With "calibrate" alpha, beta, gamma are measured in the job (calibration.h)
+ * instead of read from data_store/sample.csv, and saved to data_store/calibrated.csv:
+ * 	smpirun -n <P> -platform platform.xml ./suara2 <m> calibrate
+ *
+ * With "adaptive <iters>" the 2D plan is refitted from measured times while
+ * the allreduce is repeated iters times (adaptive.h):
+ * 	smpirun -n <P> -platform platform.xml ./suara2 <m> adaptive 200
+ *
+ * With "explore <iters>" the first calls time Stage1's top-k candidates and
+ * the measured winner is kept for the rest (explore.h):
+ * 	smpirun -n <P> -platform platform.xml ./suara2 <m> explore 50
+ *
+ * With "fusion <n> [threshold]" n small tensors are reduced one by one and
+ * then again through a fusion bucket of threshold elements (fusion.h). The
+ * default bucket holds all n tensors; threshold 0 uses fusion_crossover,
+ * which with data_store/sample.csv is only a few doubles, so nearly every
+ * tensor would bypass the bucket:
+ * 	smpirun -n <P> -platform platform.xml ./suara2 <m> fusion 200
  */
 int main(int argc, char *argv[]) {
     int rank, size;
@@ -27,18 +67,17 @@ int main(int argc, char *argv[]) {
     
     ll P = size;
     ll m = atoi(argv[1]);
-    ll ms = m/P;
-    ll * ans = malloc(3*sizeof(int));
+    ll ms = SEG_SIZE;
+    ll * ans = malloc(3*sizeof(ll));
 
     // Allocate arrays for input and intermediate results
     double *initial_data = (double*)malloc(data_vector_size * sizeof(double));
     double *local_sum = (double*)malloc(data_vector_size * sizeof(double)); 
     double *row_result = (double*)malloc(data_vector_size * sizeof(double));
-    double *col_result = (double*)malloc(data_vector_size * sizeof(double));
     
-    if (!initial_data || !local_sum || !row_result || !col_result) {
+    if (!initial_data || !local_sum || !row_result) {
         if (rank == 0) fprintf(stderr, "\033[91mError: Memory allocation failed.\033[0m\n");
-        free(initial_data); free(local_sum); free(row_result); free(col_result); 
+        free(initial_data); free(local_sum); free(row_result); 
         MPI_Finalize();
         return 1;
     }
@@ -61,8 +100,234 @@ int main(int argc, char *argv[]) {
         }
 	}
 
-    my_init("./data_store/sample.csv");
-    Stage1(P, m, ms, ans);
+    // Only rank 0 reads the parameters and selects; everyone else receives the decision
+    my_init_algos();
+    double calibration_time = -1;
+    if (argc > 2 && strcmp(argv[2], "calibrate") == 0) {
+        double abg[3][NUM_ALGOS];
+        calibration_time = calibrate(MPI_COMM_WORLD, DEFAULT_CALIBRATION_BUDGET, ms, abg);
+        set_params(abg);
+        if (rank == 0) save_params("./data_store/calibrated.csv");
+    } else if (rank == 0) {
+        load_params("./data_store/sample.csv");
+    }
+
+    if (argc > 2 && strcmp(argv[2], "topo") == 0) {
+        topo_comms tc;
+        topo_comms_create(MPI_COMM_WORLD, &tc);
+        double predicted = 0;
+        if (rank == 0) {
+            my_init_intra("./data_store/sample_intra.csv");
+            predicted = Stage1_topo(tc.nodes, tc.ppn_max, m, ms, tc.uniform, ans);
+        }
+        MPI_Bcast(ans, 2, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        double topo_mid = MPI_Wtime();
+        topo_allreduce(local_sum, row_result, data_vector_size, MPI_DOUBLE, MPI_SUM, &tc, ans[0], ans[1]);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double topo_end = MPI_Wtime();
+
+        if (rank == 0) {
+            printf("\n=== Topology-aware Summary ===\n");
+            printf("Nodes: %d, ranks per node: %d%s\n", tc.nodes, tc.ppn, tc.uniform ? "" : " (non-uniform)");
+            if (ans[0] == INTRA_SHM) printf("Intra-node algorithm: shared-memory reduce-scatter/allgather\n");
+            else printf("Intra-node algorithm: %lld\n", ans[0]);
+            printf("Inter-node algorithm: %lld\n", ans[1]);
+            printf("Predicted time: %.6f sec\n", predicted);
+            printf("All reduce time: %.6f sec\n", topo_end - topo_mid);
+            printf("Total time: %.6f sec\n", topo_end - start_time);
+            printf("===========================\n");
+        }
+
+        topo_comms_free(&tc);
+        free(initial_data); free(local_sum); free(row_result);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (argc > 3 && strcmp(argv[2], "adaptive") == 0) {
+        // every rank refits, so every rank needs the parameters
+        double abg[3][NUM_ALGOS];
+        get_params(abg);
+        MPI_Bcast(abg, 3 * NUM_ALGOS, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+        set_params(abg);
+
+        int iters = atoi(argv[3]);
+        adaptive_ctx ad;
+        adaptive_init(&ad, MPI_COMM_WORLD, m, ms);
+        ll first[3] = {ad.algos[0], ad.algos[1], ad.Pc};
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        double ad_mid = MPI_Wtime();
+        for (int it = 0; it < iters; it++)
+            adaptive_allreduce(&ad, local_sum, row_result, data_vector_size, MPI_DOUBLE, MPI_SUM);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double ad_end = MPI_Wtime();
+
+        if (rank == 0) {
+            printf("\n=== Adaptive Summary ===\n");
+            printf("Initial plan: row %lld, column %lld, Pc %lld\n", first[0], first[1], first[2]);
+            printf("Final plan: row %lld, column %lld, Pc %lld (%d switches)\n", ad.algos[0], ad.algos[1], ad.Pc, ad.switches);
+            printf("Predicted time: %.6f sec\n", ad.predicted);
+            printf("Mean all reduce time: %.6f sec over %d iterations\n", (ad_end - ad_mid) / iters, iters);
+            printf("===========================\n");
+        }
+
+        adaptive_free(&ad);
+        free(initial_data); free(local_sum); free(row_result);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (argc > 3 && strcmp(argv[2], "explore") == 0) {
+        int iters = atoi(argv[3]);
+        explore_ctx ex;
+        explore_init(&ex, MPI_COMM_WORLD, ms, EXPLORE_TOP_K);
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        double ex_mid = MPI_Wtime();
+        for (int it = 0; it < iters; it++)
+            explore_allreduce(&ex, local_sum, row_result, data_vector_size, MPI_DOUBLE, MPI_SUM);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double ex_end = MPI_Wtime();
+
+        if (rank == 0) {
+            explore_class *c = &ex.cls[stage1_bucket(data_vector_size)];
+            printf("\n=== Explore Summary ===\n");
+            for (int i = 0; i < c->ncand; i++)
+                printf("Candidate %d: row %d, column %d, Pc %lld | predicted %.6f sec, measured %.6f sec%s\n",
+                       i, c->cand[i].row, c->cand[i].col, c->cand[i].Pc, c->cand[i].time,
+                       c->measured[i] < 1e30 ? c->measured[i] : -1.0, i == c->winner ? " <- locked" : "");
+            printf("Mean all reduce time: %.6f sec over %d iterations\n", (ex_end - ex_mid) / iters, iters);
+            printf("===========================\n");
+        }
+
+        explore_free(&ex);
+        free(initial_data); free(local_sum); free(row_result);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (argc > 3 && strcmp(argv[2], "fusion") == 0) {
+        int ntensors = atoi(argv[3]);
+        ll threshold = (argc > 4) ? atoll(argv[4]) : (ll)ntensors * data_vector_size;
+        double *out = (double*)malloc((size_t)ntensors * data_vector_size * sizeof(double));
+
+        ll plan[3];
+        Stage1_root(0, MPI_COMM_WORLD, P, data_vector_size, ms, plan);
+        ll plan_algos[2] = {plan[0], plan[1]};
+        ll dims[2] = {plan[2], P / plan[2]};
+        grid_comms g;
+        grid_comms_create(MPI_COMM_WORLD, 2, dims, &g);
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        double t0 = MPI_Wtime();
+        for (int i = 0; i < ntensors; i++)
+            grid_allreduce(local_sum, out + (size_t)i * data_vector_size, data_vector_size, MPI_DOUBLE, MPI_SUM, &g, plan_algos);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double t1 = MPI_Wtime();
+
+        fusion_ctx fz;
+        fusion_init(&fz, MPI_COMM_WORLD, MPI_DOUBLE, MPI_SUM, threshold, 0.005);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double t2 = MPI_Wtime();
+        for (int i = 0; i < ntensors; i++)
+            fusion_add(&fz, local_sum, out + (size_t)i * data_vector_size, data_vector_size);
+        fusion_flush(&fz);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double t3 = MPI_Wtime();
+
+        if (rank == 0) {
+            printf("\n=== Fusion Summary ===\n");
+            printf("Tensors: %d x %d doubles\n", ntensors, data_vector_size);
+            printf("Bucket threshold: %lld doubles, %lld flushes\n", fz.threshold, fz.flushes);
+            printf("Unfused time: %.6f sec\n", t1 - t0);
+            printf("Fused time: %.6f sec\n", t3 - t2);
+            printf("===========================\n");
+        }
+
+        fusion_free(&fz);
+        grid_comms_free(&g);
+        free(out);
+        free(initial_data); free(local_sum); free(row_result);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (argc > 2 && strcmp(argv[2], "2d") == 0) {
+        ll plan[3];
+        int scheme = SCHEME_FULL;
+        double predicted = 0;
+        if (rank == 0) predicted = Stage1_2d(P, m, ms, plan, &scheme);
+        MPI_Bcast(plan, 3, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+        MPI_Bcast(&scheme, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+        ll dims[2] = {plan[2], P / plan[2]};
+        grid_comms g;
+        grid_comms_create(MPI_COMM_WORLD, 2, dims, &g);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double mid = MPI_Wtime();
+        grid_allreduce_2d(local_sum, row_result, data_vector_size, MPI_DOUBLE, MPI_SUM, &g, plan, scheme);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double end = MPI_Wtime();
+
+        if (rank == 0) {
+            printf("\n=== 2D Scheme Summary ===\n");
+            printf("Scheme: %s\n", scheme == SCHEME_RS ? "row reduce-scatter / column shard allreduce / row allgather"
+                                  : scheme == SCHEME_DUAL ? "half row-then-column, half column-then-row, concurrently"
+                                  : "row allreduce / column allreduce");
+            printf("Algorithm along row: %lld\n", plan[0]);
+            printf("Algorithm along column: %lld\n", plan[1]);
+            printf("Pc opt %lld\n", plan[2]);
+            printf("Predicted time: %.6f sec\n", predicted);
+            printf("All reduce time: %.6f sec\n", end - mid);
+            printf("Total time: %.6f sec\n", end - start_time);
+            printf("===========================\n");
+        }
+
+        grid_comms_free(&g);
+        free(initial_data); free(local_sum); free(row_result);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (argc > 3 && strcmp(argv[2], "grid") == 0) {
+        ll dims[MAX_GRID_DIMS], algos[MAX_GRID_DIMS];
+        int ndims;
+        double predicted = 0;
+        if (rank == 0) predicted = Stage1_kd(P, m, ms, atoi(argv[3]), dims, algos, &ndims);
+        MPI_Bcast(&ndims, 1, MPI_INT, 0, MPI_COMM_WORLD);
+        MPI_Bcast(dims, ndims, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+        MPI_Bcast(algos, ndims, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+
+        grid_comms g;
+        grid_comms_create(MPI_COMM_WORLD, ndims, dims, &g);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double grid_mid = MPI_Wtime();
+        grid_allreduce(local_sum, row_result, data_vector_size, MPI_DOUBLE, MPI_SUM, &g, algos);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double grid_end = MPI_Wtime();
+
+        if (rank == 0) {
+            printf("\n=== %d-D Grid Summary ===\n", ndims);
+            for (int d = 0; d < ndims; d++)
+                printf("Dimension %d: %lld ranks, algorithm %lld\n", d, dims[d], algos[d]);
+            printf("Predicted time: %.6f sec\n", predicted);
+            printf("All reduce time: %.6f sec\n", grid_end - grid_mid);
+            printf("Total time: %.6f sec\n", grid_end - start_time);
+            printf("===========================\n");
+        }
+
+        grid_comms_free(&g);
+        free(initial_data); free(local_sum); free(row_result);
+        MPI_Finalize();
+        return 0;
+    }
+
+    if (rank == 0) stage1_cache_open(STAGE1_CACHE_PATH, 1);
+    Stage1_root(0, MPI_COMM_WORLD, P, m, ms, ans);
+    if (rank == 0) stage1_cache_close();
 
     ll algorow_opt, algocol_opt, cols;
     algorow_opt = ans[0];
@@ -86,18 +351,12 @@ int main(int argc, char *argv[]) {
     
     // Perform Allreduce within each row on the full vector
     // MPI_Allreduce(local_sum, row_result, data_vector_size, MPI_DOUBLE, MPI_SUM, row_comm);
-    algo[algorow_opt](local_sum, row_result, data_vector_size, row_comm);
-
-    
-    // Update local_sum with the result of the row Allreduce
-    for (int i = 0; i < data_vector_size; i++) {
-        local_sum[i] = row_result[i];
-    }
+    algo[algorow_opt](local_sum, row_result, data_vector_size, MPI_DOUBLE, MPI_SUM, row_comm);
     
     // --- Print Full Array After Row Allreduce ---
     // printf("Process %d (Row %d, Column: %d):- After ROW Allreduce: [", rank, row_id, col_id);
     // for (int i = 0; i < data_vector_size; i++) {
-    //     printf("%.0f%s", local_sum[i], (i == data_vector_size - 1) ? "" : ", ");
+    //     printf("%.0f%s", row_result[i], (i == data_vector_size - 1) ? "" : ", ");
     // }
     // printf("]\n");
 
@@ -108,14 +367,9 @@ int main(int argc, char *argv[]) {
     key = rank; 
     MPI_Comm_split(MPI_COMM_WORLD, col_id, key, &col_comm);
 
-    // Perform Allreduce within each column, using the row result (local_sum) as input
-    // MPI_Allreduce(local_sum, col_result, data_vector_size, MPI_DOUBLE, MPI_SUM, col_comm);
-    algo[algocol_opt](local_sum, row_result, data_vector_size, col_comm);
-
-    // Update final local_sum
-    for (int i = 0; i < data_vector_size; i++) {
-        local_sum[i] = col_result[i];
-    }
+    // Perform Allreduce within each column in place on the row result
+    // MPI_Allreduce(MPI_IN_PLACE, row_result, data_vector_size, MPI_DOUBLE, MPI_SUM, col_comm);
+    algo[algocol_opt](MPI_IN_PLACE, row_result, data_vector_size, MPI_DOUBLE, MPI_SUM, col_comm);
 
     MPI_Barrier(MPI_COMM_WORLD);
     double end_time = MPI_Wtime();
@@ -131,20 +385,21 @@ int main(int argc, char *argv[]) {
     
     // printf("\033[92mProcess %d: Final vector: [", rank);
     // for (int i = 0; i < data_vector_size; i++) {
-    //     printf("%.0f%s", local_sum[i], (i == data_vector_size - 1) ? "" : ", ");
+    //     printf("%.0f%s", row_result[i], (i == data_vector_size - 1) ? "" : ", ");
     // }
     // printf("]\033[0m\n");
 
     // Clean up
     MPI_Comm_free(&row_comm);
     MPI_Comm_free(&col_comm);
-    free(initial_data); free(local_sum); free(row_result); free(col_result); 
+    free(initial_data); free(local_sum); free(row_result); 
 
     if (rank == 0) {
         printf("\n=== Simulation Summary ===\n");
         printf("Processes: %d\n", size);
         printf("Data vector size: %d doubles (%.2f KB)\n", data_vector_size, message_size_bytes / 1024.0);
         printf("Stage 1 time: %.6f sec\n", stage1_time);
+        if (calibration_time >= 0) printf("Calibration time: %.6f sec (parameters in data_store/calibrated.csv)\n", calibration_time);
         printf("Algorithm along row: %lld\n", algorow_opt);
         printf("Algorithm along column: %lld\n", algocol_opt);
         printf("Pc opt %lld\n", cols);
@@ -0,0 +1,190 @@
+#include "suara_iallreduce.h"
+#include "allreduce_plan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#define SUARA_TAG_BASE 1000
+
+struct suara_request_s {
+    int nphases, phase;
+    allreduce_plan *plans[MAX_GRID_DIMS];
+    void *sendbuf, *recvbuf;
+    int done;
+    struct suara_request_s *next;		// outstanding list walked by the progress thread
+};
+
+// Per-communicator state, kept as an attribute so it lives and dies with the communicator:
+// the tag slot of the next request started on it, and every plan built on it (busy while a
+// request runs it), reused by later requests with the same count, datatype, op, algo and tag
+typedef struct {
+    int next_slot;
+    int nplans, cap;
+    allreduce_plan **plans;
+    int *busy;
+} comm_state;
+
+static int state_keyval = MPI_KEYVAL_INVALID;
+static struct suara_request_s *outstanding = NULL;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t progress_thread;
+static volatile int progress_running = 0;
+
+static int state_delete(MPI_Comm comm, int keyval, void *attr, void *extra) {
+    (void)comm; (void)keyval; (void)extra;
+    comm_state *cs = (comm_state *) attr;
+    for (int i = 0; i < cs->nplans; i++) allreduce_plan_free(cs->plans[i]);
+    free(cs->plans);
+    free(cs->busy);
+    free(cs);
+    return MPI_SUCCESS;
+}
+
+static comm_state *get_state(MPI_Comm comm) {
+    if (state_keyval == MPI_KEYVAL_INVALID)
+        MPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, state_delete, &state_keyval, NULL);
+    comm_state *cs;
+    int found;
+    MPI_Comm_get_attr(comm, state_keyval, &cs, &found);
+    if (!found) {
+        cs = (comm_state *) calloc(1, sizeof(comm_state));
+        MPI_Comm_set_attr(comm, state_keyval, cs);
+    }
+    return cs;
+}
+
+// An idle plan for (count, datatype, op, algo) on comm with the communicator's next tag,
+// built on first use; caller holds lock
+static allreduce_plan *acquire_plan(MPI_Comm comm, ll count, MPI_Datatype datatype, MPI_Op op, int algo) {
+    comm_state *cs = get_state(comm);
+    int tag = SUARA_TAG_BASE + cs->next_slot;
+    cs->next_slot = (cs->next_slot + 1) % SUARA_TAG_WINDOW;
+
+    for (int i = 0; i < cs->nplans; i++) {
+        allreduce_plan *p = cs->plans[i];
+        if (!cs->busy[i] && p->tag == tag && p->count == count && p->datatype == datatype &&
+            p->op == op && p->algo == algo) {
+            cs->busy[i] = 1;
+            return p;
+        }
+    }
+    if (cs->nplans == cs->cap) {
+        cs->cap = cs->cap ? 2 * cs->cap : 8;
+        cs->plans = (allreduce_plan **) realloc(cs->plans, cs->cap * sizeof(allreduce_plan *));
+        cs->busy = (int *) realloc(cs->busy, cs->cap * sizeof(int));
+    }
+    allreduce_plan *p = allreduce_plan_create(comm, count, datatype, op, algo);
+    p->tag = tag;
+    cs->plans[cs->nplans] = p;
+    cs->busy[cs->nplans++] = 1;
+    return p;
+}
+
+// Hands a plan back for the next request; caller holds lock
+static void return_plan(allreduce_plan *plan) {
+    comm_state *cs = get_state(plan->comm);
+    for (int i = 0; i < cs->nplans; i++) {
+        if (cs->plans[i] == plan) cs->busy[i] = 0;
+    }
+}
+
+// Advances r as far as completed requests allow; caller holds lock
+static void advance(struct suara_request_s *r) {
+    while (!r->done) {
+        if (!allreduce_plan_test(r->plans[r->phase])) return;
+        if (++r->phase == r->nphases) {
+            r->done = 1;
+            return;
+        }
+        allreduce_plan_start(r->plans[r->phase], MPI_IN_PLACE, r->recvbuf);
+    }
+}
+
+void suara_iallreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                      grid_comms *g, const ll *algos, suara_request *request) {
+    struct suara_request_s *r = (struct suara_request_s *) calloc(1, sizeof(*r));
+    r->sendbuf = sendbuf;
+    r->recvbuf = recvbuf;
+
+    pthread_mutex_lock(&lock);
+    r->nphases = g->ndims;
+    for (int d = 0; d < g->ndims; d++) {
+        r->plans[d] = acquire_plan(g->comms[d], count, datatype, op, algos[d]);
+    }
+
+    if (r->nphases == 0) {
+        int type_size;
+        MPI_Type_size(datatype, &type_size);
+        if (!IS_IN_PLACE(sendbuf, recvbuf)) memcpy(recvbuf, sendbuf, count * type_size);
+        r->done = 1;
+    } else {
+        allreduce_plan_start(r->plans[0], sendbuf, recvbuf);
+        advance(r);
+    }
+
+    r->next = outstanding;
+    outstanding = r;
+    pthread_mutex_unlock(&lock);
+    *request = r;
+}
+
+// Unlinks and releases a completed request; caller holds lock
+static void release(struct suara_request_s *r) {
+    struct suara_request_s **p = &outstanding;
+    while (*p != r) p = &(*p)->next;
+    *p = r->next;
+    for (int d = 0; d < r->nphases; d++) return_plan(r->plans[d]);
+    free(r);
+}
+
+int suara_test(suara_request *request, int *flag) {
+    struct suara_request_s *r = *request;
+    pthread_mutex_lock(&lock);
+    advance(r);
+    *flag = r->done;
+    if (r->done) {
+        release(r);
+        *request = NULL;
+    }
+    pthread_mutex_unlock(&lock);
+    return MPI_SUCCESS;
+}
+
+void suara_wait(suara_request *request) {
+    int flag = 0;
+    while (1) {
+        suara_test(request, &flag);
+        if (flag) return;
+        if (progress_running) usleep(SUARA_PROGRESS_SLEEP_US);
+    }
+}
+
+static void *progress_loop(void *arg) {
+    (void)arg;
+    while (progress_running) {
+        pthread_mutex_lock(&lock);
+        for (struct suara_request_s *r = outstanding; r != NULL; r = r->next) advance(r);
+        pthread_mutex_unlock(&lock);
+        usleep(SUARA_PROGRESS_SLEEP_US);
+    }
+    return NULL;
+}
+
+int suara_progress_start(void) {
+    int provided;
+    MPI_Query_thread(&provided);
+    if (provided != MPI_THREAD_MULTIPLE || progress_running) return 0;
+    progress_running = 1;
+    if (pthread_create(&progress_thread, NULL, progress_loop, NULL) != 0) {
+        progress_running = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void suara_progress_stop(void) {
+    if (!progress_running) return;
+    progress_running = 0;
+    pthread_join(progress_thread, NULL);
+}
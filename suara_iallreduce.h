@@ -0,0 +1,55 @@
+#ifndef SUARA_IALLREDUCE_H
+#define SUARA_IALLREDUCE_H
+
+#include "macros.h"
+#include "grid_allreduce.h"
+
+/**
+ * @brief Nonblocking SUARA allreduce.
+ *
+ * suara_iallreduce() starts algos[0] over g->comms[0], then algos[1] over
+ * g->comms[1], ... (the row-then-column phases of suara2 when g has two
+ * dimensions) and returns at once. Each phase is an allreduce_plan walked
+ * as a state machine: a step's requests are started, and the next step
+ * begins only once suara_test() (or the progress thread) sees them complete
+ * and has applied the step's combine. Every phase after the first works in
+ * place on recvbuf.
+ *
+ * Each communicator numbers the requests started on it (a counter kept in
+ * a communicator attribute), and a phase's tag is its communicator's
+ * number modulo SUARA_TAG_WINDOW, so up to SUARA_TAG_WINDOW requests may be
+ * in flight on the same communicator. As with MPI nonblocking collectives,
+ * all ranks of a communicator must start them in the same order; the order
+ * across different communicators does not matter. Neither buffer may be
+ * touched until the request completes.
+ *
+ * Plans are kept on their communicator and reused by later requests with
+ * the same (count, datatype, op, algo, tag), so a loop of same-sized
+ * requests builds its plans once and only restarts persistent requests.
+ * They are released when the communicator is freed.
+ *
+ * Usage:
+ *     suara_request req;
+ *     suara_iallreduce(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, &g, algos, &req);
+ *     ... compute, calling suara_test(&req, &flag) now and then ...
+ *     suara_wait(&req);
+ *
+ * suara_progress_start() runs a thread that keeps advancing every
+ * outstanding request, so no test calls are needed for overlap. It needs
+ * MPI_Init_thread(..., MPI_THREAD_MULTIPLE, ...) and returns 0 otherwise.
+ */
+
+#define SUARA_PROGRESS_SLEEP_US 20		// progress thread pause between sweeps
+#define SUARA_TAG_WINDOW 64				// requests that may be in flight on one communicator
+
+typedef struct suara_request_s *suara_request;
+
+void suara_iallreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                      grid_comms *g, const ll *algos, suara_request *request);
+int suara_test(suara_request *request, int *flag);		//*flag = 1 (and *request freed) once complete
+void suara_wait(suara_request *request);
+
+int suara_progress_start(void);
+void suara_progress_stop(void);
+
+#endif
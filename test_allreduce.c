@@ -1,11 +1,44 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <mpi.h>
 #include "linear_allreduce.h"
 #include "rabenseifner_allreduce.h"
 #include "ring_allreduce.h"
 #include "ring_seg_allreduce.h"
 #include "recursive_doubling_allreduce.h"
+#include "tree_allreduce.h"
+#include "allreduce_plan.h"
+#include "suara_iallreduce.h"
+#include "grid_allreduce.h"
+#include "est_time.h"
+#include "fusion.h"
+#include "calibration.h"
+#include "topo_allreduce.h"
+
+// Every element must be reduced, including the tail when m is not a multiple of the chunk count
+static int all_equal(double *buf, int m, double expected) {
+    for (int i = 0; i < m; i++) {
+        if (buf[i] != expected) return 0;
+    }
+    return 1;
+}
+
+// Median over reps calls of the slowest rank's time, so every rank gets the same value
+static double median_time(execAllReduce fn, double *buf, ll m, int reps) {
+    double t[9];
+    for (int r = 0; r < reps; r++) {
+        for (ll i = 0; i < m; i++) buf[i] = 1;
+        MPI_Barrier(MPI_COMM_WORLD);
+        double t0 = MPI_Wtime();
+        fn(MPI_IN_PLACE, buf, m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        double mine = MPI_Wtime() - t0;
+        MPI_Allreduce(&mine, &t[r], 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    }
+    for (int i = 1; i < reps; i++)
+        for (int j = i; j > 0 && t[j] < t[j - 1]; j--) { double x = t[j]; t[j] = t[j - 1]; t[j - 1] = x; }
+    return t[reps / 2];
+}
 
 int main(int argc, char *argv[]) {
     MPI_Init(&argc, &argv);
@@ -14,45 +47,312 @@ int main(int argc, char *argv[]) {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     
-    int m = 16;
+    int m = 19;
     double *sendbuf = (double*)malloc(m * sizeof(double));
     double *recvbuf = (double*)malloc(m * sizeof(double));
     double expected = size * (size + 1) / 2.0;
     
-    // Test 1: Linear
+    // Test 1: Linear (small segments so the chain is actually pipelined)
     for(int i = 0; i < m; i++) sendbuf[i] = rank + 1;
-    linear_allreduce(sendbuf, recvbuf, m, MPI_COMM_WORLD);
+    SEG_SIZE = 4;
+    linear_allreduce(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
     printf("Rank %d | Linear              | %.1f | %s\n", 
-           rank, recvbuf[0], (recvbuf[0] == expected) ? "PASS" : "FAIL");
+           rank, recvbuf[0], all_equal(recvbuf, m, expected) ? "PASS" : "FAIL");
     MPI_Barrier(MPI_COMM_WORLD);
     
     // Test 2: Rabenseifner
     for(int i = 0; i < m; i++) sendbuf[i] = rank + 1;
-    rabenseifner_allreduce(sendbuf, recvbuf, m, MPI_COMM_WORLD);
+    rabenseifner_allreduce(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
     printf("Rank %d | Rabenseifner        | %.1f | %s\n", 
-           rank, recvbuf[0], (recvbuf[0] == expected) ? "PASS" : "FAIL");
+           rank, recvbuf[0], all_equal(recvbuf, m, expected) ? "PASS" : "FAIL");
     MPI_Barrier(MPI_COMM_WORLD);
     
     // Test 3: Ring
     for(int i = 0; i < m; i++) sendbuf[i] = rank + 1;
-    ring_allreduce(sendbuf, recvbuf, m, MPI_COMM_WORLD);
+    ring_allreduce(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
     printf("Rank %d | Ring                | %.1f | %s\n", 
-           rank, recvbuf[0], (recvbuf[0] == expected) ? "PASS" : "FAIL");
+           rank, recvbuf[0], all_equal(recvbuf, m, expected) ? "PASS" : "FAIL");
     MPI_Barrier(MPI_COMM_WORLD);
     
-    // Test 4: Ring Segmented
+    // Test 4: Ring Segmented (small segments so every chunk is actually pipelined)
     for(int i = 0; i < m; i++) sendbuf[i] = rank + 1;
-    ring_seg_allreduce(sendbuf, recvbuf, m, MPI_COMM_WORLD);
+    SEG_SIZE = 2;
+    ring_seg_allreduce(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
     printf("Rank %d | Ring Segmented      | %.1f | %s\n", 
-           rank, recvbuf[0], (recvbuf[0] == expected) ? "PASS" : "FAIL");
+           rank, recvbuf[0], all_equal(recvbuf, m, expected) ? "PASS" : "FAIL");
     MPI_Barrier(MPI_COMM_WORLD);
     
     // Test 5: Recursive Doubling
     for(int i = 0; i < m; i++) sendbuf[i] = rank + 1;
-    recursive_doubling_allreduce(sendbuf, recvbuf, m, MPI_COMM_WORLD);
+    recursive_doubling_allreduce(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
     printf("Rank %d | Recursive Doubling  | %.1f | %s\n", 
-           rank, recvbuf[0], (recvbuf[0] == expected) ? "PASS" : "FAIL");
-    
+           rank, recvbuf[0], all_equal(recvbuf, m, expected) ? "PASS" : "FAIL");
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    // Test 6: Segmented tree (small segments so the pipeline has several stages)
+    for(int i = 0; i < m; i++) sendbuf[i] = rank + 1;
+    SEG_SIZE = 4;
+    tree_allreduce(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    printf("Rank %d | Tree Segmented      | %.1f | %s\n", 
+           rank, recvbuf[0], all_equal(recvbuf, m, expected) ? "PASS" : "FAIL");
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    // Test 7: Double binary tree (odd m, so the two halves differ in length)
+    for(int i = 0; i < m; i++) sendbuf[i] = rank + 1;
+    double_tree_allreduce(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    printf("Rank %d | Double Tree         | %.1f | %s\n", 
+           rank, recvbuf[0], all_equal(recvbuf, m, expected) ? "PASS" : "FAIL");
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    // Test 8: Persistent plans, executed twice to reuse the bound requests
+    for (int a = 0; a < NUM_ALGOS; a++) {
+        allreduce_plan *plan = allreduce_plan_create(MPI_COMM_WORLD, m, MPI_DOUBLE, MPI_SUM, a);
+        int ok = 1;
+        for (int it = 0; it < 2; it++) {
+            for(int i = 0; i < m; i++) sendbuf[i] = rank + 1;
+            allreduce_plan_execute(plan, sendbuf, recvbuf);
+            ok &= all_equal(recvbuf, m, expected);
+        }
+        allreduce_plan_free(plan);
+        printf("Rank %d | Plan (algo %d)      | %.1f | %s\n",
+               rank, a, recvbuf[0], ok ? "PASS" : "FAIL");
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    // Test 9: float MAX through every kernel
+    execAllReduce kernels[NUM_ALGOS];
+    kernels[LINEAR_ALL_REDUCE] = linear_allreduce;
+    kernels[RABENSEIFNER_ALL_REDUCE] = rabenseifner_allreduce;
+    kernels[RING_ALL_REDUCE] = ring_allreduce;
+    kernels[RING_SEG_ALL_REDUCE] = ring_seg_allreduce;
+    kernels[RECURSIVE_DOUBLING_ALL_REDUCE] = recursive_doubling_allreduce;
+    kernels[TREE_ALL_REDUCE] = tree_allreduce;
+    kernels[DOUBLE_TREE_ALL_REDUCE] = double_tree_allreduce;
+    float *fsend = (float*)malloc(m * sizeof(float));
+    float *frecv = (float*)malloc(m * sizeof(float));
+    for (int a = 0; a < NUM_ALGOS; a++) {
+        for(int i = 0; i < m; i++) fsend[i] = (float)(rank + 1);
+        kernels[a](fsend, frecv, m, MPI_FLOAT, MPI_MAX, MPI_COMM_WORLD);
+        int ok = 1;
+        for(int i = 0; i < m; i++) ok &= (frecv[i] == (float)size);
+        printf("Rank %d | Float MAX (algo %d) | %.1f | %s\n",
+               rank, a, frecv[0], ok ? "PASS" : "FAIL");
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+    free(fsend);
+    free(frecv);
+
+    // Test 10: nonblocking, two requests in flight on the same communicators, progressed by
+    // suara_test; over the whole world and over a 2 x size/2 grid (row phase, then column phase)
+    grid_comms grids[2];
+    int ngrids = 1;
+    grids[0].ndims = 1;
+    grids[0].dims[0] = size;
+    grids[0].comms[0] = MPI_COMM_WORLD;
+    if (size % 2 == 0 && size > 2) {
+        grids[1].ndims = 2;
+        grids[1].dims[0] = 2;
+        grids[1].dims[1] = size / 2;
+        MPI_Comm_split(MPI_COMM_WORLD, rank / 2, rank, &grids[1].comms[0]);
+        MPI_Comm_split(MPI_COMM_WORLD, rank % 2, rank, &grids[1].comms[1]);
+        ngrids = 2;
+    }
+    double *sendbuf2 = (double*)malloc(m * sizeof(double));
+    double *recvbuf2 = (double*)malloc(m * sizeof(double));
+    for (int gi = 0; gi < ngrids; gi++) {
+        for (int a = 0; a < NUM_ALGOS; a++) {
+            ll algos[2] = {a, (a + 1) % NUM_ALGOS};
+            for(int i = 0; i < m; i++) { sendbuf[i] = rank + 1; sendbuf2[i] = 2 * (rank + 1); }
+            suara_request req1, req2;
+            suara_iallreduce(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, &grids[gi], algos, &req1);
+            suara_iallreduce(sendbuf2, recvbuf2, m, MPI_DOUBLE, MPI_SUM, &grids[gi], algos, &req2);
+            int done1 = 0, done2 = 0;
+            while (!done1 || !done2) {
+                if (!done2) suara_test(&req2, &done2);
+                if (!done1) suara_test(&req1, &done1);
+            }
+            int ok = all_equal(recvbuf, m, expected) && all_equal(recvbuf2, m, 2 * expected);
+            printf("Rank %d | Nonblocking %dD (%d)  | %.1f | %s\n",
+                   rank, grids[gi].ndims, a, recvbuf[0], ok ? "PASS" : "FAIL");
+            MPI_Barrier(MPI_COMM_WORLD);
+        }
+    }
+    if (ngrids == 2) {
+        MPI_Comm_free(&grids[1].comms[0]);
+        MPI_Comm_free(&grids[1].comms[1]);
+    }
+    free(sendbuf2);
+    free(recvbuf2);
+
+    // Test 11: MPI_IN_PLACE through every kernel and every plan, input taken from recvbuf
+    for (int a = 0; a < NUM_ALGOS; a++) {
+        for(int i = 0; i < m; i++) recvbuf[i] = rank + 1;
+        kernels[a](MPI_IN_PLACE, recvbuf, m, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        int ok = all_equal(recvbuf, m, expected);
+        allreduce_plan *plan = allreduce_plan_create(MPI_COMM_WORLD, m, MPI_DOUBLE, MPI_SUM, a);
+        for(int i = 0; i < m; i++) recvbuf[i] = rank + 1;
+        allreduce_plan_execute(plan, MPI_IN_PLACE, recvbuf);
+        ok &= all_equal(recvbuf, m, expected);
+        allreduce_plan_free(plan);
+        printf("Rank %d | In place (algo %d)  | %.1f | %s\n",
+               rank, a, recvbuf[0], ok ? "PASS" : "FAIL");
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    // Test 12: SCHEME_RS through grid_allreduce_2d, ring and Rabenseifner rows (registry
+    // reduce_scatter/allgather) with a ring column over each row position's shard; separate and
+    // in-place buffers. Rows have size/2 ranks when size is even, else size, so P = 6, 12 and odd
+    // P give non-power-of-two rows where Rabenseifner's folded-out ranks own empty shards
+    my_init_algos();
+    int Pc = (size % 2 == 0 && size > 2) ? size / 2 : size;
+    grid_comms g;
+    ll dims[2] = {Pc, size / Pc};
+    grid_comms_create(MPI_COMM_WORLD, 2, dims, &g);
+    int rs_rows[2] = {RING_ALL_REDUCE, RABENSEIFNER_ALL_REDUCE};
+    const char *rs_names[2] = {"Ring", "Rabenseifner"};
+    for (int a = 0; a < 2; a++) {
+        ll algos[2] = {rs_rows[a], RING_ALL_REDUCE};
+        for(int i = 0; i < m; i++) sendbuf[i] = rank + 1;
+        grid_allreduce_2d(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, &g, algos, SCHEME_RS);
+        int ok = all_equal(recvbuf, m, expected);
+        for(int i = 0; i < m; i++) recvbuf[i] = rank + 1;
+        grid_allreduce_2d(MPI_IN_PLACE, recvbuf, m, MPI_DOUBLE, MPI_SUM, &g, algos, SCHEME_RS);
+        ok &= all_equal(recvbuf, m, expected);
+        printf("Rank %d | RS/AG 2D (%s) | %.1f | %s\n",
+               rank, rs_names[a], recvbuf[0], ok ? "PASS" : "FAIL");
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    // Test 13: dual orientation (SCHEME_DUAL) through grid_allreduce_2d, the first half row then
+    // column and the second half column then row, both in flight at once; separate and in-place
+    // buffers, twice each so the second call runs the cached plans, and m = 1 (no second half)
+    int counts[2] = {m, 1};
+    for (int a = 0; a < NUM_ALGOS; a++) {
+        ll algos[2] = {a, (a + 1) % NUM_ALGOS};
+        int ok = 1;
+        for (int c = 0; c < 2; c++) {
+            for (int rep = 0; rep < 2; rep++) {
+                for(int i = 0; i < m; i++) sendbuf[i] = rank + 1;
+                grid_allreduce_2d(sendbuf, recvbuf, counts[c], MPI_DOUBLE, MPI_SUM, &g, algos, SCHEME_DUAL);
+                ok &= all_equal(recvbuf, counts[c], expected);
+                for(int i = 0; i < m; i++) recvbuf[i] = rank + 1;
+                grid_allreduce_2d(MPI_IN_PLACE, recvbuf, counts[c], MPI_DOUBLE, MPI_SUM, &g, algos, SCHEME_DUAL);
+                ok &= all_equal(recvbuf, counts[c], expected);
+            }
+        }
+        printf("Rank %d | Dual 2D (%d)        | %.1f | %s\n",
+               rank, a, recvbuf[0], ok ? "PASS" : "FAIL");
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    // Test 14: tensor fusion with a 16-element bucket. Tensor t holds (t + 1) * (rank + 1), so a
+    // slice scattered back to the wrong tensor shows. The sizes overflow the bucket twice, and the
+    // 20-element tensor is at or above the threshold so it runs on its own. The last tensor waits
+    // for fusion_poll: it stays queued under a long timeout and is flushed once the timeout is 0.
+    // Decisions come from rank 0, which needs the model parameters
+    if (rank == 0 && !load_params("./data_store/sample.csv")) printf("Rank 0 | Fusion: cannot open data_store/sample.csv\n");
+    ll fsizes[9] = {3, 5, 6, 4, 20, 2, 9, 7, 1};
+    ll foff[10] = {0};
+    for (int t = 0; t < 9; t++) foff[t + 1] = foff[t] + fsizes[t];
+    double *fin = (double*)malloc(foff[9] * sizeof(double));
+    double *fout = (double*)malloc(foff[9] * sizeof(double));
+    for (int t = 0; t < 9; t++)
+        for (ll i = foff[t]; i < foff[t + 1]; i++) { fin[i] = (t + 1) * (rank + 1); fout[i] = -1; }
+    fusion_ctx fz;
+    fusion_init(&fz, MPI_COMM_WORLD, MPI_DOUBLE, MPI_SUM, 16, 1e9);
+    for (int t = 0; t < 8; t++) fusion_add(&fz, fin + foff[t], fout + foff[t], fsizes[t]);
+    fusion_flush(&fz);
+    int ok = (fz.flushes == 4);
+    fusion_add(&fz, fin + foff[8], fout + foff[8], fsizes[8]);
+    fusion_poll(&fz);
+    ok &= (fz.nentries == 1);
+    fz.timeout = 0;
+    while (fz.nentries > 0) fusion_poll(&fz);
+    for (int t = 0; t < 9; t++) ok &= all_equal(fout + foff[t], fsizes[t], (t + 1) * expected);
+    fusion_free(&fz);
+    printf("Rank %d | Fusion              | %.1f | %s\n", rank, fout[0], ok ? "PASS" : "FAIL");
+    free(fin);
+    free(fout);
+
+    // Test 15: with alpha, beta, gamma calibrated in this job, the models of rnos and rs must rank
+    // the two as they measure, at two sizes where rs cuts every chunk into several segments; a gap
+    // under 10%, predicted or measured, counts as a tie
+    SEG_SIZE = DEFAULT_SEG_SIZE;
+    double abg[3][NUM_ALGOS];
+    calibrate(MPI_COMM_WORLD, DEFAULT_CALIBRATION_BUDGET, SEG_SIZE, abg);
+    set_params(abg);
+    int order_algos[2] = {RING_ALL_REDUCE, RING_SEG_ALL_REDUCE};
+    ll order_m[2] = {(ll)size * 4 * DEFAULT_SEG_SIZE, (ll)size * 32 * DEFAULT_SEG_SIZE};
+    double *obuf = (double*)malloc(order_m[1] * sizeof(double));
+    int order_ok = 1;
+    for (int sz = 0; sz < 2; sz++) {
+        double pred[2], meas[2];
+        for (int a = 0; a < 2; a++) {
+            pred[a] = algo_time(order_algos[a], size, order_m[sz], SEG_SIZE);
+            meas[a] = median_time(algo[order_algos[a]], obuf, order_m[sz], 5);
+        }
+        double pred_lo = pred[0] < pred[1] ? pred[0] : pred[1];
+        double meas_lo = meas[0] < meas[1] ? meas[0] : meas[1];
+        if (fabs(pred[0] - pred[1]) >= 0.1 * pred_lo && fabs(meas[0] - meas[1]) >= 0.1 * meas_lo)
+            order_ok &= ((pred[0] < pred[1]) == (meas[0] < meas[1]));
+        if (rank == 0) printf("Rank 0 | Model order m=%lld | rnos %.3g/%.3g s, rs %.3g/%.3g s (predicted/measured)\n",
+                              order_m[sz], pred[0], meas[0], pred[1], meas[1]);
+    }
+    printf("Rank %d | Model order         | %d | %s\n", rank, order_ok, order_ok ? "PASS" : "FAIL");
+    free(obuf);
+
+    // Test 16: nonblocking requests on the row and the column communicator, started row first on
+    // even ranks and column first on odd ones, so only per-communicator tags can match them;
+    // three rounds, the later ones running the plans kept from the first
+    grid_comms row_g = {1, {Pc}, {g.comms[0]}};
+    grid_comms col_g = {1, {size / Pc}, {g.comms[1]}};
+    double *rowbuf = (double*)malloc(m * sizeof(double));
+    double *colbuf = (double*)malloc(m * sizeof(double));
+    double row_expected = 0, col_expected = 0;
+    int row_rank, col_rank;
+    MPI_Comm_rank(g.comms[0], &row_rank);
+    MPI_Comm_rank(g.comms[1], &col_rank);
+    for (int r = 0; r < Pc; r++) row_expected += rank - row_rank + r + 1;
+    for (int c = 0; c < size / Pc; c++) col_expected += rank - col_rank * Pc + c * Pc + 1;
+    int order_ok2 = 1;
+    for (int round = 0; round < 3; round++) {
+        for(int i = 0; i < m; i++) rowbuf[i] = colbuf[i] = rank + 1;
+        ll algos[1] = {round % NUM_ALGOS};
+        suara_request req[2];
+        int first = rank % 2;
+        grid_comms *gs[2] = {&row_g, &col_g};
+        double *bufs[2] = {rowbuf, colbuf};
+        suara_iallreduce(MPI_IN_PLACE, bufs[first], m, MPI_DOUBLE, MPI_SUM, gs[first], algos, &req[first]);
+        suara_iallreduce(MPI_IN_PLACE, bufs[1 - first], m, MPI_DOUBLE, MPI_SUM, gs[1 - first], algos, &req[1 - first]);
+        suara_wait(&req[0]);
+        suara_wait(&req[1]);
+        order_ok2 &= all_equal(rowbuf, m, row_expected) && all_equal(colbuf, m, col_expected);
+    }
+    printf("Rank %d | Per-comm tags       | %.1f | %s\n", rank, rowbuf[0], order_ok2 ? "PASS" : "FAIL");
+    free(rowbuf);
+    free(colbuf);
+    grid_comms_free(&g);
+
+    // Test 17: topo_allreduce over pretend nodes of two ranks (uniform for even size, a one-rank
+    // node last for odd size): ring and Rabenseifner take the reduce-scatter path on uniform nodes,
+    // the chain always takes the leader path, and the shared-memory path falls back on odd sizes
+    MPI_Comm node_comm;
+    MPI_Comm_split(MPI_COMM_WORLD, rank / 2, rank, &node_comm);
+    topo_comms tc;
+    topo_comms_init(MPI_COMM_WORLD, node_comm, &tc);
+    int intra_algos[4] = {RING_ALL_REDUCE, RABENSEIFNER_ALL_REDUCE, LINEAR_ALL_REDUCE, INTRA_SHM};
+    for (int a = 0; a < 4; a++) {
+        for(int i = 0; i < m; i++) sendbuf[i] = rank + 1;
+        topo_allreduce(sendbuf, recvbuf, m, MPI_DOUBLE, MPI_SUM, &tc, intra_algos[a], RING_ALL_REDUCE);
+        int ok = all_equal(recvbuf, m, expected);
+        for(int i = 0; i < m; i++) recvbuf[i] = rank + 1;
+        topo_allreduce(MPI_IN_PLACE, recvbuf, m, MPI_DOUBLE, MPI_SUM, &tc, intra_algos[a], RING_ALL_REDUCE);
+        ok &= all_equal(recvbuf, m, expected);
+        printf("Rank %d | Topo (intra %d)     | %.1f | %s\n", rank, intra_algos[a], recvbuf[0], ok ? "PASS" : "FAIL");
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+    topo_comms_free(&tc);
+
     free(sendbuf);
     free(recvbuf);
     MPI_Finalize();
@@ -0,0 +1,151 @@
+#include "topo_allreduce.h"
+#include "reduce_ops.h"
+#include <string.h>
+#include <stdlib.h>
+
+void topo_comms_init(MPI_Comm comm, MPI_Comm node_comm, topo_comms *tc) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    tc->comm = comm;
+    tc->node_comm = node_comm;
+    MPI_Comm_rank(node_comm, &tc->local_rank);
+    MPI_Comm_size(node_comm, &tc->ppn);
+
+    // Column of the node grid: same local rank on every node
+    MPI_Comm_split(comm, tc->local_rank, rank, &tc->cross_comm);
+
+    int is_leader = (tc->local_rank == 0);
+    MPI_Allreduce(&is_leader, &tc->nodes, 1, MPI_INT, MPI_SUM, comm);
+    tc->node_id = 0;
+    if (is_leader) MPI_Comm_rank(tc->cross_comm, &tc->node_id);
+    MPI_Bcast(&tc->node_id, 1, MPI_INT, 0, node_comm);
+
+    int ppn_min, ppn_max;
+    MPI_Allreduce(&tc->ppn, &ppn_min, 1, MPI_INT, MPI_MIN, comm);
+    MPI_Allreduce(&tc->ppn, &ppn_max, 1, MPI_INT, MPI_MAX, comm);
+    tc->uniform = (ppn_min == ppn_max);
+    tc->ppn_max = ppn_max;
+
+    tc->win = MPI_WIN_NULL;
+    tc->win_bytes = 0;
+    tc->segments = (char **) calloc(tc->ppn, sizeof(char *));
+}
+
+void topo_comms_create(MPI_Comm comm, topo_comms *tc) {
+    int rank;
+    MPI_Comm node_comm;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+    topo_comms_init(comm, node_comm, tc);
+}
+
+static void release_window(topo_comms *tc) {
+    if (tc->win == MPI_WIN_NULL) return;
+    MPI_Win_unlock_all(tc->win);
+    MPI_Win_free(&tc->win);
+    tc->win_bytes = 0;
+}
+
+void topo_comms_free(topo_comms *tc) {
+    release_window(tc);
+    free(tc->segments);
+    MPI_Comm_free(&tc->cross_comm);
+    MPI_Comm_free(&tc->node_comm);
+}
+
+// The window is kept between calls and only grows, so steady-state calls allocate nothing
+static void ensure_window(topo_comms *tc, MPI_Aint bytes) {
+    if (tc->win != MPI_WIN_NULL && tc->win_bytes >= bytes) return;
+    release_window(tc);
+
+    char *base;
+    MPI_Win_allocate_shared(bytes > 0 ? bytes : 1, 1, MPI_INFO_NULL, tc->node_comm, &base, &tc->win);
+    for (int l = 0; l < tc->ppn; l++) {
+        MPI_Aint seg_bytes;
+        int disp_unit;
+        MPI_Win_shared_query(tc->win, l, &seg_bytes, &disp_unit, &tc->segments[l]);
+    }
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, tc->win);
+    tc->win_bytes = bytes;
+}
+
+// Make the node's stores to the window visible to every local rank
+static void node_fence(topo_comms *tc) {
+    MPI_Win_sync(tc->win);
+    MPI_Barrier(tc->node_comm);
+    MPI_Win_sync(tc->win);
+}
+
+static void shm_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                          topo_comms *tc, int inter_algo) {
+    int type_size;
+    MPI_Type_size(datatype, &type_size);
+    reduce_fn reduce = get_reduce_fn_or_abort(datatype, op, tc->comm);
+    int l = tc->local_rank, ppn = tc->ppn;
+
+    ensure_window(tc, (MPI_Aint)count * type_size);
+    char *mine = tc->segments[l];
+    char *recv_buf = (char *)recvbuf;
+
+    ll *shard_off = (ll *) malloc(sizeof(ll) * (ppn + 1));
+    chunk_offsets(count, ppn, shard_off);
+    ll shard_len = shard_off[l + 1] - shard_off[l];
+    char *shard = recv_buf + shard_off[l] * type_size;
+
+    memcpy(mine, IS_IN_PLACE(sendbuf, recvbuf) ? recvbuf : sendbuf, count * type_size);
+    node_fence(tc);
+
+    // Reduce-scatter: combine shard l of every local rank, starting at a
+    // different peer on each rank so they do not all read the same segment
+    memcpy(shard, mine + shard_off[l] * type_size, shard_len * type_size);
+    for (int p = 1; p < ppn; p++) {
+        int q = (l + p) % ppn;
+        reduce_apply(reduce, shard, tc->segments[q] + shard_off[l] * type_size, shard_len, type_size);
+    }
+
+    // Inter-node allreduce of the shard; the result lands back in our own segment
+    algo[inter_algo](shard, mine + shard_off[l] * type_size, shard_len, datatype, op, tc->cross_comm);
+    node_fence(tc);
+
+    // Allgather: every shard is read from the segment of the rank that owns it
+    for (int q = 0; q < ppn; q++) {
+        memcpy(recv_buf + shard_off[q] * type_size, tc->segments[q] + shard_off[q] * type_size,
+               (shard_off[q + 1] - shard_off[q]) * type_size);
+    }
+    // Nobody may overwrite its segment in the next call before everyone has copied out
+    MPI_Barrier(tc->node_comm);
+
+    free(shard_off);
+}
+
+void topo_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                    topo_comms *tc, int intra_algo, int inter_algo) {
+    if (intra_algo == INTRA_SHM && tc->uniform) {
+        shm_allreduce(sendbuf, recvbuf, count, datatype, op, tc, inter_algo);
+        return;
+    }
+    if (intra_algo == INTRA_SHM) intra_algo = RING_ALL_REDUCE;
+
+    // On uniform nodes local rank l holds the same shard of the intra reduce-scatter on every
+    // node, so the inter level only moves that shard, once per local rank
+    algo_entry *intra = &algo_registry[intra_algo];
+    if (tc->uniform && intra->reduce_scatter != NULL) {
+        int type_size;
+        MPI_Type_size(datatype, &type_size);
+        if (!IS_IN_PLACE(sendbuf, recvbuf)) memcpy(recvbuf, sendbuf, count * type_size);
+        ll shard_off, shard_len;
+        intra->reduce_scatter(recvbuf, count, datatype, op, tc->node_comm, &shard_off, &shard_len);
+        if (shard_len > 0) {
+            algo[inter_algo](MPI_IN_PLACE, (char *)recvbuf + shard_off * type_size, shard_len, datatype, op, tc->cross_comm);
+        }
+        intra->allgather(recvbuf, count, datatype, tc->node_comm);
+        return;
+    }
+
+    // Otherwise only the node leaders run the inter level, on the node's whole result
+    algo[intra_algo](sendbuf, recvbuf, count, datatype, op, tc->node_comm);
+    if (tc->local_rank == 0) {
+        algo[inter_algo](MPI_IN_PLACE, recvbuf, count, datatype, op, tc->cross_comm);
+    }
+    MPI_Bcast(recvbuf, count, datatype, 0, tc->node_comm);
+}
@@ -0,0 +1,54 @@
+#ifndef TOPO_ALLREDUCE_H
+#define TOPO_ALLREDUCE_H
+
+#include "macros.h"
+
+/**
+ * @brief Topology-aware two-level allreduce: intra-node, then inter-node.
+ *
+ * Ranks are grouped by node with MPI_Comm_split_type(MPI_COMM_TYPE_SHARED)
+ * instead of by rank / cols, so the intra level always runs over the fast
+ * node-local links.
+ *
+ * intra_algo == INTRA_SHM:
+ *     shared-memory reduce-scatter inside the node (each local rank combines
+ *     its count/ppn shard straight out of its peers' window segments), the
+ *     inter_algo allreduce of that shard across the ranks holding the same
+ *     shard on every node, and a shared-memory allgather.
+ * intra_algo with a registry reduce_scatter (ring, Rabenseifner):
+ *     the same three stages with intra_algo's reduce-scatter and allgather
+ *     over node_comm, so each local rank sends only its own shard across
+ *     nodes.
+ * any other intra_algo:
+ *     full allreduce inside the node with algo[intra_algo], a full allreduce
+ *     with algo[inter_algo] among the node leaders only, and an MPI_Bcast of
+ *     the result inside the node.
+ *
+ * Nodes with different rank counts cannot line their shards up, so in that
+ * case every intra_algo takes the leader path (INTRA_SHM runs as the ring).
+ */
+
+#define INTRA_SHM NUM_ALGOS				//intra_algo value selecting the shared-memory reduce-scatter/allgather
+
+typedef struct {
+    MPI_Comm comm;          // the parent communicator
+    MPI_Comm node_comm;     // ranks sharing this node
+    MPI_Comm cross_comm;    // ranks with the same node-local rank, one per node
+    int local_rank, ppn;
+    int node_id, nodes;
+    int uniform;            // every node holds ppn ranks
+    int ppn_max;            // ranks on the largest node
+
+    MPI_Win win;            // shared window, one segment per local rank (INTRA_SHM)
+    MPI_Aint win_bytes;     // per-rank segment size currently allocated
+    char **segments;        // segments[l]: local rank l's segment, valid on this rank
+} topo_comms;
+
+void topo_comms_create(MPI_Comm comm, topo_comms *tc);
+void topo_comms_init(MPI_Comm comm, MPI_Comm node_comm, topo_comms *tc);	//use a caller-built node communicator
+void topo_comms_free(topo_comms *tc);
+
+void topo_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op,
+                    topo_comms *tc, int intra_algo, int inter_algo);
+
+#endif
@@ -0,0 +1,194 @@
+#include "tree_allreduce.h"
+#include "reduce_ops.h"
+#include <string.h>
+#include <stdlib.h>
+
+void btree_links(int rank, int size, int *parent, int child[2]) {
+    int bit;
+    for (bit = 1; bit < size; bit <<= 1) {
+        if (bit & rank) break;
+    }
+    child[0] = child[1] = -1;
+    if (rank == 0) {
+        *parent = -1;
+        if (size > 1) child[0] = bit >> 1;
+        return;
+    }
+
+    *parent = (rank ^ bit) | (bit << 1);
+    if (*parent >= size) *parent = rank ^ bit;
+
+    // The left child always exists below an interior rank; the right one may fall past size - 1
+    int low = bit >> 1;
+    if (low) child[0] = rank - low;
+    while (low && rank + low >= size) low >>= 1;
+    if (low) child[1] = rank + low;
+}
+
+// Tree 1 renumbers the ranks so that its leaves (odd positions) are tree 0's interior ranks:
+// mirrored for even P, shifted by one for odd P (where the mirror would keep rank parity)
+static int dbtree_pos(int rank, int size) {
+    return (size % 2 == 0) ? size - 1 - rank : (rank + size - 1) % size;
+}
+
+static int dbtree_rank(int pos, int size) {
+    return (size % 2 == 0) ? size - 1 - pos : (pos + 1) % size;
+}
+
+void dbtree_links(int tree, int rank, int size, int *parent, int child[2]) {
+    if (tree == 0) {
+        btree_links(rank, size, parent, child);
+        return;
+    }
+    btree_links(dbtree_pos(rank, size), size, parent, child);
+    if (*parent >= 0) *parent = dbtree_rank(*parent, size);
+    for (int c = 0; c < 2; c++) {
+        if (child[c] >= 0) child[c] = dbtree_rank(child[c], size);
+    }
+}
+
+ll dbtree_split(ll count) {
+    return (count + 1) / 2;
+}
+
+// One pipelined tree over a slice of recvbuf: tag carries the reduce, tag + 1 the broadcast
+typedef struct {
+    int parent, child[2];
+    char *buf;
+    ll count, seg_size;
+    int nseg, tag;
+    char *slots;
+    MPI_Request recv_req[2][2];
+    MPI_Request *up_req, *down_req;
+} tree_pipe;
+
+static void pipe_init(tree_pipe *t, int parent, const int child[2], char *buf, ll count, int type_size, int tag) {
+    t->parent = parent;
+    t->child[0] = child[0];
+    t->child[1] = child[1];
+    t->buf = buf;
+    t->count = count;
+    t->seg_size = (SEG_SIZE > 0 && SEG_SIZE < count) ? SEG_SIZE : count;
+    t->nseg = count > 0 ? (int)((count + t->seg_size - 1) / t->seg_size) : 0;
+    t->tag = tag;
+
+    // Two landing slots per child, so segment k+1 can arrive while segment k is combined
+    t->slots = (char *) reduce_alloc(type_size * t->seg_size * 4);
+    t->up_req = (MPI_Request *) malloc(sizeof(MPI_Request) * (t->nseg + 1));
+    t->down_req = (MPI_Request *) malloc(sizeof(MPI_Request) * (3 * t->nseg + 1));
+    for (int k = 0; k < t->nseg; k++) t->up_req[k] = MPI_REQUEST_NULL;
+    for (int k = 0; k < 3 * t->nseg; k++) t->down_req[k] = MPI_REQUEST_NULL;
+}
+
+static ll pipe_seg_len(const tree_pipe *t, int k) {
+    return (k == t->nseg - 1) ? t->count - k * t->seg_size : t->seg_size;
+}
+
+// Round k of the reduce (k = 0..nseg): post the children's segment k, then combine
+// segment k-1 and send it up as soon as both children's copies are in
+static void pipe_reduce_round(tree_pipe *t, int k, MPI_Datatype datatype, MPI_Comm comm, reduce_fn reduce, int type_size) {
+    if (k < t->nseg) {
+        for (int c = 0; c < 2; c++) {
+            if (t->child[c] < 0) continue;
+            char *slot = t->slots + (2 * c + (k & 1)) * t->seg_size * type_size;
+            MPI_Irecv(slot, pipe_seg_len(t, k), datatype, t->child[c], t->tag, comm, &t->recv_req[c][k & 1]);
+        }
+    }
+    if (k == 0 || k > t->nseg) return;
+
+    int s = k - 1;
+    ll off = s * t->seg_size;
+    ll len = pipe_seg_len(t, s);
+    for (int c = 0; c < 2; c++) {
+        if (t->child[c] < 0) continue;
+        MPI_Wait(&t->recv_req[c][s & 1], MPI_STATUS_IGNORE);
+        reduce_apply(reduce, t->buf + off * type_size, t->slots + (2 * c + (s & 1)) * t->seg_size * type_size, len, type_size);
+    }
+    if (t->parent >= 0) {
+        MPI_Isend(t->buf + off * type_size, len, datatype, t->parent, t->tag, comm, &t->up_req[s]);
+    }
+}
+
+// Segment k of the result lands in place once our partial sum of it has left
+static void pipe_post_bcast(tree_pipe *t, MPI_Datatype datatype, MPI_Comm comm, int type_size) {
+    MPI_Request *from_parent = t->down_req + 2 * t->nseg;
+    if (t->parent < 0) return;
+    for (int k = 0; k < t->nseg; k++) {
+        MPI_Wait(&t->up_req[k], MPI_STATUS_IGNORE);
+        MPI_Irecv(t->buf + k * t->seg_size * type_size, pipe_seg_len(t, k), datatype, t->parent, t->tag + 1, comm, &from_parent[k]);
+    }
+}
+
+static void pipe_bcast_round(tree_pipe *t, int k, MPI_Datatype datatype, MPI_Comm comm, int type_size) {
+    if (k >= t->nseg) return;
+    MPI_Wait(&t->down_req[2 * t->nseg + k], MPI_STATUS_IGNORE);
+    for (int c = 0; c < 2; c++) {
+        if (t->child[c] < 0) continue;
+        MPI_Isend(t->buf + k * t->seg_size * type_size, pipe_seg_len(t, k), datatype, t->child[c], t->tag + 1, comm, &t->down_req[c * t->nseg + k]);
+    }
+}
+
+static void pipe_finish(tree_pipe *t) {
+    MPI_Waitall(2 * t->nseg, t->down_req, MPI_STATUSES_IGNORE);
+    free(t->down_req);
+    free(t->up_req);
+    free(t->slots);
+}
+
+void tree_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm) {
+    int rank, size, type_size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    MPI_Type_size(datatype, &type_size);
+    reduce_fn reduce = get_reduce_fn_or_abort(datatype, op, comm);
+
+    char *send_buf = (char*)sendbuf;
+    char *recv_buf = (char*)recvbuf;
+
+    if (!IS_IN_PLACE(send_buf, recv_buf)) memcpy(recv_buf, send_buf, type_size * count);
+    if (size == 1 || count == 0) return;
+
+    int parent, child[2];
+    btree_links(rank, size, &parent, child);
+    tree_pipe t;
+    pipe_init(&t, parent, child, recv_buf, count, type_size, 0);
+
+    for (int k = 0; k <= t.nseg; k++) pipe_reduce_round(&t, k, datatype, comm, reduce, type_size);
+    pipe_post_bcast(&t, datatype, comm, type_size);
+    for (int k = 0; k < t.nseg; k++) pipe_bcast_round(&t, k, datatype, comm, type_size);
+    pipe_finish(&t);
+}
+
+void double_tree_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm) {
+    int rank, size, type_size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    MPI_Type_size(datatype, &type_size);
+    reduce_fn reduce = get_reduce_fn_or_abort(datatype, op, comm);
+
+    char *send_buf = (char*)sendbuf;
+    char *recv_buf = (char*)recvbuf;
+
+    if (!IS_IN_PLACE(send_buf, recv_buf)) memcpy(recv_buf, send_buf, type_size * count);
+    if (size == 1 || count == 0) return;
+
+    // Tree 0 carries the first half, tree 1 the second; their rounds are interleaved so a
+    // rank's interior work in one tree overlaps its leaf sends in the other
+    ll half = dbtree_split(count);
+    tree_pipe t[2];
+    for (int i = 0; i < 2; i++) {
+        int parent, child[2];
+        dbtree_links(i, rank, size, &parent, child);
+        pipe_init(&t[i], parent, child, recv_buf + (i ? half * type_size : 0), i ? count - half : half, type_size, 2 * i);
+    }
+    int rounds = t[0].nseg > t[1].nseg ? t[0].nseg : t[1].nseg;
+
+    for (int k = 0; k <= rounds; k++) {
+        for (int i = 0; i < 2; i++) pipe_reduce_round(&t[i], k, datatype, comm, reduce, type_size);
+    }
+    for (int i = 0; i < 2; i++) pipe_post_bcast(&t[i], datatype, comm, type_size);
+    for (int k = 0; k < rounds; k++) {
+        for (int i = 0; i < 2; i++) pipe_bcast_round(&t[i], k, datatype, comm, type_size);
+    }
+    for (int i = 0; i < 2; i++) pipe_finish(&t[i]);
+}
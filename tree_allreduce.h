@@ -0,0 +1,44 @@
+#ifndef TREE_ALLREDUCE_H
+#define TREE_ALLREDUCE_H
+
+#include "macros.h"
+
+/**
+ * @brief Segmented binary-tree allreduce: pipelined reduce to rank 0, then pipelined broadcast.
+ *
+ * The tree is the in-order binary tree over ranks 0..P-1 (rank r's level is
+ * its lowest set bit): rank 0 is the root with a single child, every other
+ * rank has at most two, odd ranks are leaves and the depth is ceil(log2 P)
+ * for any P. The buffer is cut into SEG_SIZE element segments; a rank
+ * forwards segment k to its parent as soon as both children's segment k
+ * have been combined into it, and forwards segment k of the result to its
+ * children as soon as it arrives. This is the schedule hockneytime_tree()
+ * models with ms = SEG_SIZE.
+ */
+
+void tree_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm);
+
+/**
+ * @brief Double binary tree allreduce: two complementary pipelined trees, each over half the buffer.
+ *
+ * Tree 0 is the tree above and carries the first dbtree_split(count)
+ * elements; tree 1 is the same tree over renumbered ranks (mirrored for
+ * even P, shifted by one for odd P) and carries the rest. A rank that is a
+ * leaf in one tree is interior in the other, so no uplink sits idle and a
+ * rank takes in about m elements per phase instead of an interior rank's 2m
+ * in a single tree. Both pipelines run at once, round by round. This is the
+ * schedule hockneytime_dbt() models with ms = SEG_SIZE.
+ */
+
+void double_tree_allreduce(void *sendbuf, void *recvbuf, ll count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm);
+
+// Parent (-1 at the root) and children (-1 when absent) of rank in the tree above
+void btree_links(int rank, int size, int *parent, int child[2]);
+
+// Same, in tree 0 or tree 1 of the double binary tree; peers are ranks of comm
+void dbtree_links(int tree, int rank, int size, int *parent, int child[2]);
+
+// Number of leading elements tree 0 carries
+ll dbtree_split(ll count);
+
+#endif
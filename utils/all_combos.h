@@ -1,106 +0,0 @@
-// #pragma once
-
-
-double lin_rab(long long P, long long m, long long ms,
-               double alpha_beta_gamma[3][NUM_ALGOS],
-               ll *Pc_ptr);
-
-double lin_rd(long long P, long long m, long long ms,
-              double alpha_beta_gamma[3][NUM_ALGOS],
-              ll *Pc_ptr);
-
-double lin_rnos(long long P, long long m, long long ms,
-                double alpha_beta_gamma[3][NUM_ALGOS],
-                ll *Pc_ptr);
-
-double lin_rs(long long P, long long m, long long ms,
-              double alpha_beta_gamma[3][NUM_ALGOS],
-              ll *Pc_ptr);
-
-double lin_lin(long long P, long long m, long long ms,
-               double alpha_beta_gamma[3][NUM_ALGOS],
-               ll *Pc_ptr);
-
-
-double rab_rab(long long P, long long m, long long ms,
-               double alpha_beta_gamma[3][NUM_ALGOS],
-               ll *Pc_ptr);
-
-double rab_rd(long long P, long long m, long long ms,
-              double alpha_beta_gamma[3][NUM_ALGOS],
-              ll *Pc_ptr);
-
-double rab_rnos(long long P, long long m, long long ms,
-                double alpha_beta_gamma[3][NUM_ALGOS],
-                ll *Pc_ptr);
-
-double rab_rs(long long P, long long m, long long ms,
-              double alpha_beta_gamma[3][NUM_ALGOS],
-              ll *Pc_ptr);
-
-double rab_lin(long long P, long long m, long long ms,
-               double alpha_beta_gamma[3][NUM_ALGOS],
-               ll *Pc_ptr);
-
-
-double rd_rab(long long P, long long m, long long ms,
-               double alpha_beta_gamma[3][NUM_ALGOS],
-               ll *Pc_ptr);
-
-double rd_rd(long long P, long long m, long long ms,
-              double alpha_beta_gamma[3][NUM_ALGOS],
-              ll *Pc_ptr);
-
-double rd_rnos(long long P, long long m, long long ms,
-                double alpha_beta_gamma[3][NUM_ALGOS],
-                ll *Pc_ptr);
-
-double rd_rs(long long P, long long m, long long ms,
-              double alpha_beta_gamma[3][NUM_ALGOS],
-              ll *Pc_ptr);
-
-double rd_lin(long long P, long long m, long long ms,
-               double alpha_beta_gamma[3][NUM_ALGOS],
-               ll *Pc_ptr);
-
-
-double rs_rab(long long P, long long m, long long ms,
-               double alpha_beta_gamma[3][NUM_ALGOS],
-               ll *Pc_ptr);
-
-double rs_rd(long long P, long long m, long long ms,
-              double alpha_beta_gamma[3][NUM_ALGOS],
-              ll *Pc_ptr);
-
-double rs_rnos(long long P, long long m, long long ms,
-                double alpha_beta_gamma[3][NUM_ALGOS],
-                ll *Pc_ptr);
-
-double rs_rs(long long P, long long m, long long ms,
-              double alpha_beta_gamma[3][NUM_ALGOS],
-              ll *Pc_ptr);
-
-double rs_lin(long long P, long long m, long long ms,
-               double alpha_beta_gamma[3][NUM_ALGOS],
-               ll *Pc_ptr);
-
-
-double rnos_rab(long long P, long long m, long long ms,
-               double alpha_beta_gamma[3][NUM_ALGOS],
-               ll *Pc_ptr);
-
-double rnos_rd(long long P, long long m, long long ms,
-              double alpha_beta_gamma[3][NUM_ALGOS],
-              ll *Pc_ptr);
-
-double rnos_rnos(long long P, long long m, long long ms,
-                double alpha_beta_gamma[3][NUM_ALGOS],
-                ll *Pc_ptr);
-
-double rnos_rs(long long P, long long m, long long ms,
-              double alpha_beta_gamma[3][NUM_ALGOS],
-              ll *Pc_ptr);
-
-double rnos_lin(long long P, long long m, long long ms,
-               double alpha_beta_gamma[3][NUM_ALGOS],
-               ll *Pc_ptr);
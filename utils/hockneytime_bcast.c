@@ -0,0 +1,12 @@
+#include"../macros.h"
+
+//Binomial-tree broadcast of m elements over P ranks (topo_allreduce's MPI_Bcast on non-uniform nodes):
+//ceil(log2 P) rounds, each forwarding the whole message; nothing is combined, so gamma is unused
+double hockneytime_bcast(ll P, ll m, ll ms, double alpha, double beta, double gamma){
+	if(P <= 1 || m <= 0)
+		return 0;
+	int rounds = 0;
+	for(ll reach = 1; reach < P; reach *= 2)
+		rounds++;
+	return rounds*(alpha + beta*m);
+}
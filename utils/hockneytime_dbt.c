@@ -0,0 +1,21 @@
+#include"../macros.h"
+#include"../reduce_ops.h"
+
+double hockneytime_dbt(ll P, ll m, ll ms, double alpha, double beta, double gamma){
+	if(P <= 1 || m <= 0)
+		return 0;
+	//each tree pipelines half of the buffer
+	ll half = (m + 1)/2;
+	if(ms <= 0 || ms > half)
+		ms = half;
+	ll nseg = (half + ms - 1)/ms;
+	ll depth = 0;
+	while((1LL << depth) < P)
+		depth++;
+	//every stage a rank takes in two segments (both children in its interior tree) and sends two
+	//(one to its parent in each tree); with P = 2 each rank is one tree's root and the other's leaf
+	int fan = (P > 2) ? 2 : 1;
+	double reduce = (depth + nseg - 1) * fan * (alpha + beta * ms + gamma_eff(gamma, ms) * ms);
+	double bcast = (depth + nseg - 1) * fan * (alpha + beta * ms);
+	return reduce + bcast;
+}
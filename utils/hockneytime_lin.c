@@ -1,5 +1,13 @@
 #include"../macros.h"
+#include"../reduce_ops.h"
 
 double hockneytime_lin(ll P, ll m, ll ms, double alpha, double beta, double gamma){
-	return (P-1)*(alpha*2 + beta*m*2 + gamma*m);
+	if(P <= 1 || m <= 0)
+		return 0;
+	if(ms <= 0 || ms > m)
+		ms = m;
+	ll nseg = (m + ms - 1)/ms;
+	//the reduce and the broadcast each fill a (P-1)-link pipeline with nseg segments;
+	//with one segment this is the store-and-forward chain, (P-1)(2 alpha + 2 beta m + gamma m)
+	return (P + nseg - 2)*(alpha*2 + beta*ms*2 + gamma_eff(gamma, ms)*ms);
 }
@@ -1,5 +1,15 @@
 #include"../macros.h"
+#include"../reduce_ops.h"
 
 double hockneytime_rab(ll P, ll m, ll ms, double alpha, double beta, double gamma){
-	return  2.0*log(P)/log(2)*alpha + (P-1)/(double)P * (2*beta*m + gamma*m);
+	ll pof2 = 1;
+	while(pof2*2 <= P)
+		pof2 *= 2;
+	//the reduce-scatter halves the combined block every level, so each level gets its own gamma(m)
+	double reduce = 0;
+	for(ll half = m/2, k = 1; k < pof2; k *= 2, half /= 2)
+		reduce += gamma_eff(gamma, half)*half;
+	//non power-of-2 P: one fold step before and one unfold step after the power-of-2 core
+	double fold = (pof2 == P) ? 0 : 2*(alpha + beta*m) + gamma_eff(gamma, m)*m;
+	return  2.0*log(pof2)/log(2)*alpha + (pof2-1)/(double)pof2 * 2*beta*m + reduce + fold;
 }
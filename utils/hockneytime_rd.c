@@ -1,6 +1,13 @@
 #include"../macros.h"
+#include"../reduce_ops.h"
 
 double hockneytime_rd(ll P, ll m, ll ms, double alpha, double beta, double gamma){
-	return log(P)/log(2) * (alpha *m + beta * m + gamma);  	
+	ll pof2 = 1;
+	while(pof2*2 <= P)
+		pof2 *= 2;
+	double gamma_m = gamma_eff(gamma, m);
+	//non power-of-2 P: one fold step before and one unfold step after the power-of-2 core
+	double fold = (pof2 == P) ? 0 : 2*(alpha + beta*m) + gamma_m*m;
+	return log(pof2)/log(2) * (alpha + beta * m + gamma_m * m) + fold;  	
 }
      
@@ -1,5 +1,7 @@
 #include"../macros.h"
+#include"../reduce_ops.h"
 
 double hockneytime_rnos(ll P, ll m, ll ms, double alpha, double beta, double gamma){
-	return 2*(P-1)*alpha + (P-1)/(double)P * (2*beta*m + gamma*m);
+	//every reduce step combines one m/P chunk
+	return 2*(P-1)*alpha + (P-1)/(double)P * (2*beta*m + gamma_eff(gamma, m/P)*m);
 }
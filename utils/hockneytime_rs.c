@@ -1,5 +1,17 @@
 #include"../macros.h"
+#include"../reduce_ops.h"
 
 double hockneytime_rs(ll P, ll m, ll ms, double alpha, double beta, double gamma){
-	return (P + m/(ms * P) -2) * (alpha + beta * ms + gamma * ms) + (P-1)*(alpha + beta * m/P); 
+	if(P <= 1)
+		return 0;
+	ll chunk = (m + P - 1)/P;
+	if(chunk < 1)
+		chunk = 1;
+	if(ms <= 0 || ms > chunk)
+		ms = chunk;
+	ll nseg = (chunk + ms - 1)/ms;
+	//every one of the 2(P-1) steps still moves a whole chunk over each link and pays alpha per segment;
+	//pipelining only hides the combines behind the next segment's transfer, except the one segment
+	//each reduce step has to finish before it can forward it
+	return 2*(P-1)*(nseg*alpha + beta*chunk) + (P-1)*gamma_eff(gamma, ms)*ms;
 }
@@ -0,0 +1,11 @@
+#include"../macros.h"
+#include"../reduce_ops.h"
+
+//Shared-memory reduce-scatter + allgather inside one node of P ranks (topo_allreduce with INTRA_SHM):
+//each rank reads and combines the other P-1 copies of its m/P shard, then copies the P-1 other shards back
+double hockneytime_shm(ll P, ll m, ll ms, double alpha, double beta, double gamma){
+	if(P <= 1)
+		return 0;
+	double shard_elems = (P-1)/(double)P * m;
+	return 2*alpha + shard_elems * (2*beta + gamma_eff(gamma, m/P));
+}
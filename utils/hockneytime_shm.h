@@ -0,0 +1,3 @@
+#include"../macros.h"
+
+double hockneytime_shm(ll P, ll m, ll ms, double alpha, double beta, double gamma);
@@ -0,0 +1,19 @@
+#include"../macros.h"
+#include"../reduce_ops.h"
+
+double hockneytime_tree(ll P, ll m, ll ms, double alpha, double beta, double gamma){
+	if(P <= 1 || m <= 0)
+		return 0;
+	if(ms <= 0 || ms > m)
+		ms = m;
+	ll nseg = (m + ms - 1)/ms;
+	ll depth = 0;
+	while((1LL << depth) < P)
+		depth++;
+	//an interior rank takes in (reduce) or sends out (broadcast) one segment per child each stage;
+	//with P = 2 the root's single child is the whole tree
+	int fan = (P > 2) ? 2 : 1;
+	double reduce = (depth + nseg - 1) * fan * (alpha + beta * ms + gamma_eff(gamma, ms) * ms);
+	double bcast = (depth + nseg - 1) * fan * (alpha + beta * ms);
+	return reduce + bcast;
+}
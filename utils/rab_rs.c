@@ -1,55 +0,0 @@
-#include"../macros.h"
-#include"hockneytime_rab.h"
-#include"hockneytime_rs.h"
-
-
-
-//typedef double (*getTimeandPc)(ll, ll, double, double, double, ll*);
-
-
-double rab_rs(long long P, long long m, long long ms, double alpha_beta_gamma[3][NUM_ALGOS], ll * Pc_ptr){
-	long long pow1 = 1;
-
-	double alpha_row = alpha_beta_gamma[0][RABENSEIFNER_ALL_REDUCE];
-	double beta_row = alpha_beta_gamma[1][RABENSEIFNER_ALL_REDUCE];
-	double gamma_row = alpha_beta_gamma[2][RABENSEIFNER_ALL_REDUCE];
-	double alpha_column = alpha_beta_gamma[0][RING_SEG_ALL_REDUCE];
-	double beta_column = alpha_beta_gamma[1][RING_SEG_ALL_REDUCE];
-	double gamma_column =  alpha_beta_gamma[2][RING_SEG_ALL_REDUCE];
-
-	while(pow1 <= P){
-		pow1 *= 2;
-	}	
-	pow1 /= 2;
-	//now pow1 is the highest power of 2 in P
-	ll Pc_opt=1;
-	double t_opt=1e10;
-	if(P == pow1){
-		//brute force check all pow1 combinations
-		for(int Pc_cand=1; Pc_cand < P; Pc_cand *= 2){
-			double t_cand = hockneytime_rab(Pc_cand, m, ms, alpha_row, beta_row, gamma_row)
-							+ hockneytime_rs(P/Pc_cand, m, ms, alpha_column, beta_column, gamma_column);
-			if(t_cand < t_opt){
-				Pc_opt = Pc_cand;
-				t_opt = t_cand;
-			}
-		}
-			
-	}
-	else{
-		//use the derivative
-        //instead, use al factors
-		for(int i=0; i < NUM_FACTORS; i+=1){
-			int Pc_cand = factorsP[i];
-			double t_cand = hockneytime_rab(Pc_cand, m, ms, alpha_row, beta_row, gamma_row)
-							+ hockneytime_rs(P/Pc_cand, m, ms, alpha_column, beta_column, gamma_column);
-			if(t_cand < t_opt){
-				Pc_opt = Pc_cand;
-				t_opt = t_cand;
-			}
-		}
-	}
-	*Pc_ptr = Pc_opt;
-	times41[RABENSEIFNER_ALL_REDUCE][RING_SEG_ALL_REDUCE] = t_opt;
-	return t_opt;
-}